@@ -1,10 +1,12 @@
 #include <iostream>
+#include <algorithm>
 
 #include "FreeTypeHelper.h"
 #include "geometry.h"
 #include "resourcesMaster.h"
 
 std::unique_ptr<BasicRenderPipeline> FontGlobals::wordProgram;
+size_t Font::layoutCacheSize = 1024;
 Font FontGlobals::tnr;
 
 
@@ -14,41 +16,14 @@ Character::Character(char c) : Sprite()
 
     //characters are ALWAYS transluscent. They are always a mix of red pixels and black pixels, the latter of which the fragment shader then deletes
     //by that definition, they are technically always opaque but because the black pixels are basically transparent, they are actually always transluscent
-    transluscent = true;
+    alpha.type = ALPHA_TRANSLUSCENT;
 
 }
 
 Character::Character(char c, FT_Face& face) : Character(c)
 {
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D,texture);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
-
-    if ( FT_Load_Char(face,c,FT_LOAD_RENDER))
-    {
-        throw std::logic_error ("ERROR::FREETYTPE: Failed to load Glyph" + c);
-    }
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGBA,
-        face->glyph->bitmap.width,
-        face->glyph->bitmap.rows,
-        0,
-        GL_RED,
-        GL_UNSIGNED_BYTE,
-        face->glyph->bitmap.buffer
-    );
-
-   // glGenerateMipmap(GL_TEXTURE_2D);
-
-    //std::cout << glGetError() << std::endl;
-    //std::cout << texture << std::endl;
+    //the glyph itself goes in the Font's GlyphAtlas, characters just keep track of their metrics. Font::init already rendered the glyph into face->glyph
+    //for the atlas, so we read the metrics from there rather than rendering it a second time
     size =     glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows);
     bearing =  glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
     advance =    face->glyph->advance.x;
@@ -68,6 +43,89 @@ GLuint Character::getAdvance()
     return advance;
 }
 
+GlyphAtlas::GlyphAtlas() : Sprite()
+{
+    alpha.type = ALPHA_TRANSLUSCENT; //same as Character
+    for (int i = 0; i < 128; ++i)
+    {
+        rects[i] = glm::vec4(0);
+    }
+}
+
+void GlyphAtlas::add(GLchar c, const FT_Bitmap& bitmap)
+{
+    if (bitmap.width == 0 || bitmap.rows == 0) //spaces and control characters, nothing to draw
+    {
+        return;
+    }
+    Glyph glyph;
+    glyph.c = c & 127;
+    glyph.width = bitmap.width;
+    glyph.height = bitmap.rows;
+    glyph.pixels.resize(glyph.width*glyph.height);
+    for (int row = 0; row < glyph.height; ++row) //rows can be padded, so copy them one at a time
+    {
+        memcpy(&glyph.pixels[row*glyph.width],bitmap.buffer + row*bitmap.pitch,glyph.width);
+    }
+    glyphs.push_back(std::move(glyph));
+}
+
+void GlyphAtlas::pack()
+{
+    //tallest first, so every shelf is about as tall as everything on it
+    std::sort(glyphs.begin(),glyphs.end(),[](const Glyph& a, const Glyph& b){
+              return a.height > b.height;
+              });
+    const int padding = 1; //so linear filtering doesn't bleed in the glyph next door
+    width = 512;
+    for (const Glyph& glyph : glyphs)
+    {
+        width = std::max(width,glyph.width + padding*2);
+    }
+    int x = padding, y = padding, shelfHeight = 0;
+    for (Glyph& glyph : glyphs)
+    {
+        if (x + glyph.width + padding > width) //start a new shelf
+        {
+            y += shelfHeight + padding;
+            x = padding;
+            shelfHeight = 0;
+        }
+        glyph.x = x;
+        glyph.y = y;
+        x += glyph.width + padding;
+        shelfHeight = std::max(shelfHeight,glyph.height);
+    }
+    height = y + shelfHeight + padding;
+
+    std::vector<unsigned char> pixels(width*height,0);
+    for (const Glyph& glyph : glyphs)
+    {
+        for (int row = 0; row < glyph.height; ++row)
+        {
+            memcpy(&pixels[(glyph.y + row)*width + glyph.x],&glyph.pixels[row*glyph.width],glyph.width);
+        }
+        rects[glyph.c] = glm::vec4(glyph.x/(float)width,glyph.y/(float)height,glyph.width/(float)width,glyph.height/(float)height);
+    }
+
+    glGenTextures(1, &texture);
+    GLState::bindTexture(GL_TEXTURE_2D,texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_R8,width,height,0,GL_RED,GL_UNSIGNED_BYTE,pixels.data());
+    state = LOADED;
+    glyphs.clear();
+    glyphs.shrink_to_fit(); //only needed until we're packed
+}
+
+const glm::vec4& GlyphAtlas::getRect(GLchar c) const
+{
+    return rects[c & 127];
+}
+
 int Font::writeLength(std::string str)
 {
     int length = 0;
@@ -82,9 +140,9 @@ int Font::writeLength(std::string str)
     void FontGlobals::init(int screenWidth, int screenHeight)
     {
         std::string source = templateShader(stripComments(readFile(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/betterShader.h").first), true,
-                                            {"vec4 color"},
+                                            {"vec4 color","vec4 glyphRect"},
                                             {"vec4 shade"},
-                                            {"shade = color"});
+                                            {"shade = color","texCoord = glyphRect.xy + texCoord*glyphRect.zw"});
         wordProgram = std::unique_ptr<BasicRenderPipeline>(new BasicRenderPipeline({LoadShaderInfo{source,GL_VERTEX_SHADER,false},
                                                                                    LoadShaderInfo{ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/wordFragment.h",GL_FRAGMENT_SHADER,true}}));
 
@@ -124,9 +182,80 @@ glm::vec2 Font::getDimen(std::string text, GLfloat hScale, GLfloat vScale)
     return {maxWidth,maxHeight*vScale};
 }
 
+bool Font::LayoutKey::operator==(const LayoutKey& other) const
+{
+    return text == other.text && scale == other.scale && align == other.align && vertAlign == other.vertAlign && size == other.size && angle == other.angle;
+}
+
+size_t Font::LayoutKeyHash::operator()(const LayoutKey& key) const
+{
+    size_t hash = std::hash<std::string_view>()(key.text);
+    for (float value : {key.scale,key.size.x,key.size.y,key.angle,(float)key.align,(float)key.vertAlign})
+    {
+        hash ^= std::hash<float>()(value) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
 void Font::requestWrite(const FontParameter& param, BasicRenderPipeline& pipeline)
 {
-    glm::vec4 absRect = absoluteValueRect(param.rect);
+    std::lock_guard<std::mutex> lock(layoutMutex);
+    const Layout& layout = getLayout(param);
+    for (const GlyphQuad& quad : layout)
+    {
+        glm::vec4 rect = quad.rect;
+        rect.x += param.rect.x;
+        rect.y += param.rect.y;
+        SpriteManager::requestSprite({pipeline,&atlas},rect,param.z,param.angle,0,param.color,atlas.getRect(quad.c));
+    }
+}
+
+const Font::Layout& Font::getLayout(const FontParameter& param)
+{
+    if (layoutCacheSize == 0)
+    {
+        layoutMisses++;
+        layOut(param,uncached);
+        return uncached;
+    }
+    LayoutKey key = {param.text,param.scale,param.align,param.vertAlign,glm::vec2(param.rect.z,param.rect.a),param.angle}; //views param.text, no copy
+    auto found = layoutLookup.find(key);
+    if (found != layoutLookup.end())
+    {
+        layoutHits++;
+        layouts.splice(layouts.begin(),layouts,found->second); //move to the front, iterators stay valid
+        return found->second->layout;
+    }
+    layoutMisses++;
+    while (layouts.size() > layoutCacheSize) //the cache size may have shrunk since last time
+    {
+        layoutLookup.erase(layouts.back().key);
+        layouts.pop_back();
+    }
+    if (layouts.size() == layoutCacheSize)
+    {
+        //full, so reuse the least recently used entry. Its text and layout already have memory we can write over
+        layoutLookup.erase(layouts.back().key);
+        layouts.splice(layouts.begin(),layouts,std::prev(layouts.end()));
+    }
+    else
+    {
+        layouts.emplace_front();
+    }
+    CachedLayout& cached = layouts.front();
+    cached.text = param.text;
+    cached.key = key;
+    cached.key.text = cached.text;
+    layoutLookup[cached.key] = layouts.begin();
+    layOut(param,cached.layout);
+    return cached.layout;
+}
+
+void Font::layOut(const FontParameter& param, Layout& layout)
+{
+    layout.clear();
+    glm::vec4 rect = glm::vec4(0,0,param.rect.z,param.rect.a); //everything is relative to the rect, requestWrite moves it to where the rect actually is
+    glm::vec4 absRect = absoluteValueRect(rect);
 
     glm::vec2 dimen = getDimen(param.text,1,1);
 
@@ -150,25 +279,26 @@ void Font::requestWrite(const FontParameter& param, BasicRenderPipeline& pipelin
     switch (param.align)
     {
     case RIGHT:
-        x += param.rect.z - dimen.x*scale;
+        x += rect.z - dimen.x*scale;
         break;
     case CENTER:
-        x += param.rect.z/2 - dimen.x/2*scale;
+        x += rect.z/2 - dimen.x/2*scale;
         break;
     }
     switch (param.vertAlign)
     {
     case VERTCENTER:
-        y += param.rect.a/2 - dimen.y/2*scale;
+        y += rect.a/2 - dimen.y/2*scale;
        // PolyRender::requestRect(glm::vec4(x,y,getDimen(param.text,scale,scale)),glm::vec4(1,0,0,1),false,0,1);
         break;
     case DOWN:
-        y += param.rect.a - dimen.y*scale;
+        y += rect.a - dimen.y*scale;
         break;
     }
 
-    int startX = x;
+    double startX = x;
     int size = param.text.size();
+    layout.reserve(size);
     //PolyRender::requestRect(param.rect,{1,0,0,1},false,0,1);
     //PolyRender::requestRect(absRect,{1,0,1,1},false,0,5);
     //PolyRender::requestRect(glm::vec4(x,y,absRect.z,absRect.a),glm::vec4(1,0,0,1),false,0,5);
@@ -195,9 +325,9 @@ void Font::requestWrite(const FontParameter& param, BasicRenderPipeline& pipelin
         //PolyRender::requestRect(glm::vec4(xpos,ypos,w,h),glm::vec4(1,0,0,1),false,0,5);
 
 
-        glm::vec4 finalRect = glm::vec4(rotateRect({xpos,ypos,w,h},{param.rect.x + param.rect.z/2,param.rect.y + param.rect.a/2},param.angle));
+        glm::vec4 finalRect = glm::vec4(rotateRect({xpos,ypos,w,h},{rect.z/2,rect.a/2},param.angle));
 
-        SpriteManager::requestSprite({pipeline,characters[c].get()},finalRect,param.z,param.angle,0,param.color);
+        layout.push_back({finalRect,c});
 
         x += (ch->getAdvance() >> 6 )*scale;
     }
@@ -205,6 +335,23 @@ void Font::requestWrite(const FontParameter& param, BasicRenderPipeline& pipelin
    // std::cout << "End: " << writeRequests.size() << std::endl;
 }
 
+const GlyphAtlas& Font::getAtlas()
+{
+    return atlas;
+}
+
+unsigned long long Font::getLayoutHits()
+{
+    std::lock_guard<std::mutex> lock(layoutMutex);
+    return layoutHits;
+}
+
+unsigned long long Font::getLayoutMisses()
+{
+    std::lock_guard<std::mutex> lock(layoutMutex);
+    return layoutMisses;
+}
+
 Font::~Font()
 {
    // requests.clear();
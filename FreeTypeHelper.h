@@ -7,6 +7,8 @@
 #include <unordered_map>
 #include <memory>
 #include <list>
+#include <mutex>
+#include <string_view>
 
 #include "geometry.h"
 #include "render.h"
@@ -39,7 +41,7 @@ struct FontParameter //Represents all the information  required to call the writ
 };
 
 
-class Character : public Sprite//represents a character in a font
+class Character : public Sprite//represents a character in a font. Only its metrics, it doesn't own a texture; the glyph is in its Font's GlyphAtlas (see Font::getAtlas)
 {
     char letter;
 protected:
@@ -48,18 +50,36 @@ protected:
     GLuint advance; //the total width the character takes up, including the character width, the horizontal bearing, and the space from the next character
     Character(char c); //use this constructor if loading the texture is handled by some child class constructor
 public:
-    Character(char c, FT_Face& face);
+    Character(char c, FT_Face& face); //reads the metrics of the glyph already rendered into face->glyph, see Font::init
     const glm::ivec2& getBearing();
     const glm::ivec2& getSize();
     GLuint getAdvance();
 
 };
 
+class GlyphAtlas : public Sprite //every glyph of a Font in one texture, so all of a font's text can be drawn in one batch
+{
+    glm::vec4 rects[128]; //where each character's glyph is, normalized
+    struct Glyph
+    {
+        GLubyte c = 0;
+        int width = 0, height = 0;
+        int x = 0, y = 0; //where it goes in the atlas
+        std::vector<unsigned char> pixels;
+    };
+    std::vector<Glyph> glyphs; //added but not packed yet
+public:
+    GlyphAtlas();
+    void add(GLchar c, const FT_Bitmap& bitmap); //copies a rendered glyph to be packed by pack
+    void pack(); //packs every added glyph into shelves, tallest first, and uploads them
+    const glm::vec4& getRect(GLchar c) const;
+};
+
 class Font;
 struct FontGlobals
 {
     static Font tnr; //the default alef font
-    static std::unique_ptr<BasicRenderPipeline> wordProgram;
+    static std::unique_ptr<BasicRenderPipeline> wordProgram; //its last input is the glyph's rect in the font's GlyphAtlas
 
     static void init(int screenWidth,int screenHeight); //initializes wordProgram and the default alef font
 };
@@ -70,8 +90,46 @@ class Font
     std::string font = "";
 protected:
     std::unordered_map<GLchar,std::unique_ptr<Character>> characters;
+    GlyphAtlas atlas;
     int writeLength(std::string str);
+
+    //requestWrite remembers where it put every glyph of the last layoutCacheSize strings, so labels that don't change don't have to be laid out every frame
+    struct GlyphQuad
+    {
+        glm::vec4 rect; //relative to the FontParameter's rect
+        GLchar c;
+    };
+    typedef std::vector<GlyphQuad> Layout;
+    struct LayoutKey //everything that changes where the glyphs go, other than where the rect is
+    {
+        std::string_view text; //views the CachedLayout's own copy once cached, so looking one up doesn't have to copy the text
+        float scale;
+        Align align;
+        VertAlign vertAlign;
+        glm::vec2 size; //the rect's width and height
+        float angle;
+        bool operator==(const LayoutKey& other) const;
+    };
+    struct LayoutKeyHash
+    {
+        size_t operator()(const LayoutKey& key) const;
+    };
+    struct CachedLayout
+    {
+        std::string text; //what the key's text views. List nodes never move, so the view stays valid
+        LayoutKey key;
+        Layout layout;
+    };
+    typedef std::list<CachedLayout> LayoutList;
+    LayoutList layouts; //most recently used first
+    std::unordered_map<LayoutKey,LayoutList::iterator,LayoutKeyHash> layoutLookup;
+    Layout uncached; //where the layout goes if the cache is off
+    std::mutex layoutMutex; //requestWrite can be called from any thread, like SpriteManager::requestSprite
+    unsigned long long layoutHits = 0, layoutMisses = 0;
+    const Layout& getLayout(const FontParameter& param); //the cached layout for "param", laying it out if there isn't one. Lock layoutMutex first
+    void layOut(const FontParameter& param, Layout& layout); //where every glyph of "param" goes, relative to param.rect
 public:
+    static size_t layoutCacheSize; //how many layouts each font remembers before throwing out the least recently used. 0 turns the cache off
     Font(std::string source);
     Font()
     {
@@ -98,7 +156,11 @@ public:
         //glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         for (GLubyte c = 0; c < 128; c++)
         {
-
+            //render every glyph once: the character reads its metrics from it, and the atlas copies the bitmap
+            if (FT_Load_Char(face,c,FT_LOAD_RENDER))
+            {
+                throw std::logic_error("ERROR::FREETYTPE: Failed to load Glyph " + std::to_string(c));
+            }
             // Now store character for later use
             T* character = new T(c,face);
             glm::ivec2 bearing = (character->getBearing());
@@ -112,16 +174,22 @@ public:
                 maxVert.y = size.y - bearing.y;
             }
             characters[c] = std::unique_ptr<Character>(character);
+            atlas.add(c,face->glyph->bitmap);
         }
+        atlas.pack();
 
         FT_Done_Face(face);
         FT_Done_FreeType(library);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+        GLState::bindVertexArray(0);
 
     }
     glm::vec2 getDimen(std::string text, GLfloat hScale, GLfloat vScale); //gets the dimensions on text printed if the text were to be printed. The height is based on the bearing rather than the actual character height
+    //"pipeline"'s inputs have to be the same as wordProgram's: every glyph comes from "atlas", so the last one is the glyph's rect in it
     virtual void requestWrite(const FontParameter& param, BasicRenderPipeline& pipeline = *FontGlobals::wordProgram); //idk, I feel like the pipeline should not be part of the FontParameter. I can't explain why, just a gut feeling
+    const GlyphAtlas& getAtlas();
+    unsigned long long getLayoutHits(); //requestWrite calls that reused a cached layout
+    unsigned long long getLayoutMisses(); //requestWrite calls that had to lay their text out
     Character& getChar(GLchar c)
     {
         return *characters[c].get();
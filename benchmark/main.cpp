@@ -1,23 +1,302 @@
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
 
 #include <time.h>
 #include <SDL.h>
 
-#include "physics.h"
 #include "render.h"
 #include "SDLHelper.h"
 #include "FreeTypeHelper.h"
 #include "resourcesMaster.h"
-#include "components.h"
+
+/*Runs a set of named scenarios, each for a fixed number of frames after a warm up, and reports frame time percentiles along with how many draw calls,
+bytes uploaded, and heap allocations each frame took. Results go to a CSV and/or JSON file so runs can be compared between versions of the library.
+Run with --help for the options.*/
+
+//counts every heap allocation so we can check that the render path doesn't allocate once it's warmed up
+unsigned long long allocations = 0;
+void* operator new(size_t size)
+{
+    allocations++;
+    if (void* ptr = malloc(size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+struct Options
+{
+    std::vector<std::string> scenarios; //empty means all of them
+    int frames = 600; //frames we measure
+    int warmup = 60; //frames we run first and throw away, so buffers have grown and the driver has settled
+    int width = 1920;
+    int height = 1080;
+    bool offscreen = true; //render into a framebuffer in a hidden window
+    bool fullscreen = false; //only if not offscreen
+    bool gpu = false; //turn on GPUProfiler
+    bool list = false; //print every scenario and exit
+    std::string csv = "";
+    std::string json = "";
+};
+
+struct Scenario
+{
+    std::string name;
+    std::string description;
+    std::function<void(int)> request; //makes every request for one frame, given the frame number
+};
+
+//every scenario's name and description, in the order they run. Kept apart from what they request so --list works without a window or a GPU
+const std::vector<std::pair<std::string,std::string>> scenarioList = {
+    {"sprites","100k copies of one sprite at one z"},
+    {"distinctSprites","100k sprites spread across 256 textures at one z"},
+    {"zInterleaved","100k sprites alternating between 2 textures across 512 zs, so batches can't span zs"},
+    {"text","2000 labels using 500 different strings, which stay the same every frame"},
+    {"changingText","2000 lines of text that change every frame, so every one misses the layout cache"},
+    {"polygons","30k rotated rects, 16-gons, and lines"},
+    {"circles","20k selection rings and 10k filled circles"},
+    {"panels","20k nine-slice panels of different sizes"},
+    {"mixed","50k sprites across 16 textures and 8 zs, 300 labels, and 5k polygons"}
+};
+
+struct Result
+{
+    std::string scenario;
+    int frames = 0;
+    double mean = 0, p50 = 0, p95 = 0, p99 = 0, min = 0, max = 0; //frame times, in ms
+    double drawCalls = 0; //per frame
+    double bytesUploaded = 0; //per frame
+    double bindsIssued = 0, bindsSkipped = 0; //per frame, see GLState
+    double allocations = 0; //per frame
+    double gpuMs = -1; //GPU time per frame of everything GPUProfiler timed, -1 if it was off
+};
+
+bool quit = false; //true if the window was closed, in which case we stop wherever we are
+
+void printHelp()
+{
+    std::cout << "Options:\n"
+              << "  --scenario NAME   run only NAME, can be repeated. Runs every scenario by default\n"
+              << "  --list            list every scenario and exit\n"
+              << "  --frames N        frames to measure (default 600)\n"
+              << "  --warmup N        frames to run before measuring (default 60)\n"
+              << "  --width N, --height N\n"
+              << "  --windowed        render to a visible window rather than offscreen\n"
+              << "  --fullscreen      same as --windowed, but fullscreen\n"
+              << "  --gpu             also time the GPU with GPUProfiler\n"
+              << "  --csv PATH, --json PATH  where to write results. Without either, a CSV goes in data/\n";
+}
+
+bool parseOptions(int args, char* argsc[], Options& options)
+{
+    for (int i = 1; i < args; ++i)
+    {
+        std::string arg = argsc[i];
+        bool hasValue = i + 1 < args;
+        if (arg == "--scenario" && hasValue)
+        {
+            options.scenarios.push_back(argsc[++i]);
+        }
+        else if (arg == "--frames" && hasValue)
+        {
+            options.frames = std::max(1,atoi(argsc[++i]));
+        }
+        else if (arg == "--warmup" && hasValue)
+        {
+            options.warmup = std::max(0,atoi(argsc[++i]));
+        }
+        else if (arg == "--width" && hasValue)
+        {
+            options.width = atoi(argsc[++i]);
+        }
+        else if (arg == "--height" && hasValue)
+        {
+            options.height = atoi(argsc[++i]);
+        }
+        else if (arg == "--windowed")
+        {
+            options.offscreen = false;
+        }
+        else if (arg == "--fullscreen")
+        {
+            options.offscreen = false;
+            options.fullscreen = true;
+        }
+        else if (arg == "--gpu")
+        {
+            options.gpu = true;
+        }
+        else if (arg == "--csv" && hasValue)
+        {
+            options.csv = argsc[++i];
+        }
+        else if (arg == "--json" && hasValue)
+        {
+            options.json = argsc[++i];
+        }
+        else if (arg == "--list")
+        {
+            options.list = true;
+        }
+        else
+        {
+            if (arg != "--help")
+            {
+                std::cout << "Unknown option: " << arg << "\n";
+            }
+            printHelp();
+            return false;
+        }
+    }
+    return true;
+}
+
+double percentile(const std::vector<double>& sorted, double p) //nearest rank
+{
+    if (sorted.size() == 0)
+    {
+        return 0;
+    }
+    size_t rank = ceil(p*sorted.size());
+    return sorted[std::min(sorted.size(),std::max(rank,(size_t)1)) - 1];
+}
+
+Result runScenario(const Scenario& scenario, const Options& options)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    Result result;
+    result.scenario = scenario.name;
+
+    std::vector<double> times;
+    times.reserve(options.frames);
+    unsigned long long drawCalls = 0, bytesUploaded = 0, bindsIssued = 0, bindsSkipped = 0, frameAllocations = 0;
+    GPUProfiler::reset();
+
+    SDL_Event e;
+    for (int frame = 0; frame < options.warmup + options.frames && !quit; ++frame)
+    {
+        while (SDL_PollEvent(&e))
+        {
+            KeyManager::update(e);
+            MouseManager::update(e);
+            quit = quit || e.type == SDL_QUIT;
+        }
+        if (frame == options.warmup)
+        {
+            GPUProfiler::reset(); //don't count warm up frames
+        }
+
+        Clock::time_point start = Clock::now();
+        RenderCounters::reset();
+        unsigned long long allocationsBefore = allocations;
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        scenario.request(frame);
+
+        ViewPort::update();
+        SpriteManager::render();
+        PolyRender::render();
+        GLContext::update();
+        DeltaTime::update();
+
+        if (frame >= options.warmup)
+        {
+            times.push_back(std::chrono::duration<double,std::milli>(Clock::now() - start).count());
+            drawCalls += RenderCounters::drawCalls;
+            bytesUploaded += RenderCounters::bytesUploaded;
+            bindsIssued += RenderCounters::bindsIssued;
+            bindsSkipped += RenderCounters::bindsSkipped;
+            frameAllocations += allocations - allocationsBefore;
+        }
+    }
+
+    result.frames = times.size();
+    if (result.frames > 0)
+    {
+        double total = 0;
+        for (double time : times)
+        {
+            total += time;
+        }
+        std::sort(times.begin(),times.end());
+        result.mean = total/result.frames;
+        result.p50 = percentile(times,.5);
+        result.p95 = percentile(times,.95);
+        result.p99 = percentile(times,.99);
+        result.min = times.front();
+        result.max = times.back();
+        result.drawCalls = (double)drawCalls/result.frames;
+        result.bytesUploaded = (double)bytesUploaded/result.frames;
+        result.bindsIssued = (double)bindsIssued/result.frames;
+        result.bindsSkipped = (double)bindsSkipped/result.frames;
+        result.allocations = (double)frameAllocations/result.frames;
+    }
+    if (options.gpu && GPUProfiler::getFramesRead() > 0)
+    {
+        result.gpuMs = GPUProfiler::getTotalMs()/GPUProfiler::getFramesRead();
+    }
+    return result;
+}
+
+void writeCSV(std::ostream& stream, const std::vector<Result>& results)
+{
+    stream << "scenario,frames,mean_ms,p50_ms,p95_ms,p99_ms,min_ms,max_ms,draw_calls,bytes_uploaded,binds_issued,binds_skipped,allocations,gpu_ms\n";
+    for (const Result& result : results)
+    {
+        stream << result.scenario << "," << result.frames << "," << result.mean << "," << result.p50 << "," << result.p95 << "," << result.p99 << ","
+               << result.min << "," << result.max << "," << result.drawCalls << "," << result.bytesUploaded << "," << result.bindsIssued << "," << result.bindsSkipped << "," << result.allocations << "," << result.gpuMs << "\n";
+    }
+}
+
+void writeJSON(std::ostream& stream, const std::vector<Result>& results, const Options& options, const std::string& date)
+{
+    stream << "{\n  \"date\": \"" << date << "\",\n  \"width\": " << options.width << ",\n  \"height\": " << options.height
+           << ",\n  \"offscreen\": " << (options.offscreen ? "true" : "false") << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& result = results[i];
+        stream << "    {\"scenario\": \"" << result.scenario << "\", \"frames\": " << result.frames
+               << ", \"mean_ms\": " << result.mean << ", \"p50_ms\": " << result.p50 << ", \"p95_ms\": " << result.p95 << ", \"p99_ms\": " << result.p99
+               << ", \"min_ms\": " << result.min << ", \"max_ms\": " << result.max
+               << ", \"draw_calls\": " << result.drawCalls << ", \"bytes_uploaded\": " << result.bytesUploaded
+               << ", \"binds_issued\": " << result.bindsIssued << ", \"binds_skipped\": " << result.bindsSkipped << ", \"allocations\": " << result.allocations
+               << ", \"gpu_ms\": " << result.gpuMs << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    stream << "  ]\n}\n";
+}
 
 int main(int args, char* argsc[])
 {
-    //delete ptr;
-    const int screenWidth = 1920;
-    const int screenHeight = 1080;
+    Options options;
+    if (!parseOptions(args,argsc,options))
+    {
+        return 1;
+    }
+    if (options.list)
+    {
+        for (auto& scenario : scenarioList)
+        {
+            std::cout << scenario.first << ": " << scenario.second << "\n";
+        }
+        return 0;
+    }
+    const int screenWidth = options.width;
+    const int screenHeight = options.height;
 
-    srand(time(NULL));
+    srand(0); //same "random" numbers every run, so runs are comparable
 
     ResourcesConfig::loadConfig();
 
@@ -30,144 +309,206 @@ int main(int args, char* argsc[])
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS,1);
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES,4);
 
-    GLContext::init(screenWidth,screenHeight,true);
+    GLContext::init(screenWidth,screenHeight,options.fullscreen,options.offscreen);
+    SDL_GL_SetSwapInterval(0); //we want to know how fast we are, not the refresh rate
 
     glEnable(GL_MULTISAMPLE);
 
     glDisable(GL_DEPTH_TEST);
-    glEnable(GL_ALPHA_TEST);
-    glAlphaFunc(GL_GREATER,0.1);
 
     SDL_StopTextInput();
 
     ViewPort::init(screenWidth,screenHeight);
+    GPUProfiler::enabled = options.gpu;
 
     FontGlobals::init(screenWidth, screenHeight);
     PolyRender::init(screenWidth,screenHeight);
-    SDL_Event e;
-    bool quit = false;
     glClearColor(1,1,1,1);
-    bool eventsEmpty = true;
 
-    /*RenderCamera camera;
-    ViewPort::setZRange((0.1,100);
-    camera.init({0,0,CAMERA_Z});
-    ViewPort::currentCamera = &camera;*/
+    if (options.offscreen)
+    {
+        //the default framebuffer of a hidden window might not get drawn to at all, so draw into our own
+        GLuint framebuffer, color, depth;
+        glGenFramebuffers(1,&framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+
+        glGenRenderbuffers(1,&color);
+        glBindRenderbuffer(GL_RENDERBUFFER,color);
+        glRenderbufferStorage(GL_RENDERBUFFER,GL_RGBA8,screenWidth,screenHeight);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_RENDERBUFFER,color);
+
+        glGenRenderbuffers(1,&depth);
+        glBindRenderbuffer(GL_RENDERBUFFER,depth);
+        glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH24_STENCIL8,screenWidth,screenHeight);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_STENCIL_ATTACHMENT,GL_RENDERBUFFER,depth);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "Couldn't make the offscreen framebuffer, run with --windowed\n";
+            return 1;
+        }
+        glViewport(0,0,screenWidth,screenHeight);
+    }
 
     Sprite sub("./sprites/TheSeeker.png");
-    float lineVerts[36] = {0,0,0,
-                            320,320,0,
-                            0,640,0,
-
-                            0,0,0,
-                            320,320,0,
-                            640,0,0,
-
-                            0,640,0,
-                            320,320,0,
-                            640,640,0,
-
-                            640,0,0,
-                            320,320,0
-                            ,640,640,0
-                            };
-    float colors[8] = {1,0,0,1,1,0,0,1};
-    //BasicRenderPipeline line("../../resources/shaders/vertex/polygonVertex.h","../../resources/shaders/fragment/simpleFragment.h",{0,0},&lineVerts[0],3,3);
-    //BasicRenderPipeline light("../../resources/shaders/vertex/polygonVertexTest.h","../../resources/shaders/fragment/simpleFragment.h",{0,1,0,1},&lineVerts[0],3,12);
-
-
-    int instances = 100000;
-
-    std::vector<char> bytes;
-    bytes.reserve(instances*sizeof(TightTuple<char,short,int,float,bool>));
-    int average = 0;
-    int frames = 0;
-
-    std::time_t t = std::time(0);
-    std::tm* now = std::localtime(&t);
-
-
-    std::string date = std::to_string(now->tm_mon + 1) + "_" + std::to_string(now->tm_mday)+"_" + std::to_string(now->tm_year+1900);
-    std::ofstream benchmark;
-    benchmark.open("data/benchmark_"+ date +"_" + std::to_string(time(0)) + ".txt");
-
-    while (!quit)
+    Sprite9 panel("./sprites/TheSeeker.png",glm::vec2(8,8),glm::vec2(8,8));
+    std::vector<std::unique_ptr<Sprite>> distinct; //same image, but every one is its own texture, so every one is its own batch
+    for (int i = 0; i < 256; ++i)
     {
-        while (SDL_PollEvent(&e))
+        distinct.emplace_back(new Sprite());
+        distinct.back()->loadAsync("./sprites/TheSeeker.png");
+    }
+    SpriteLoader::waitAll(); //scenarios shouldn't be timing placeholders
+
+    const int dimen = 50;
+    const int perRow = screenWidth/dimen;
+    auto gridRect = [perRow,dimen](int i){
+        return glm::vec4(i%perRow*dimen,i/perRow%(perRow)*dimen,dimen,dimen);
+    };
+    auto requestSprites = [&](int amount, int sprites, int zs){
+        for (int i = 0; i < amount; ++i)
         {
-            eventsEmpty = false;
-            KeyManager::update(e);
-            MouseManager::update(e);
-            if (e.type == SDL_QUIT)
-            {
-                quit = true;
-                std::cout << average/frames << "\n";
-            }
+            Sprite* sprite = sprites == 1 ? &sub : distinct[i%sprites].get();
+            SpriteManager::requestSprite({*ViewPort::basicProgram,sprite},gridRect(i),zs == 1 ? 0 : i%zs,0.0f,0);
         }
-        if (eventsEmpty)
+    };
+    //text is built once, up front, so making the strings doesn't count towards our allocations. "variants" versions of "amount" lines,
+    //one version per frame; with enough versions nothing is still in the layout cache by the time it comes back around
+    auto makeText = [&](int amount, int variants, int distinct){
+        std::vector<FontParameter> lines(amount*variants);
+        for (int i = 0; i < amount*variants; ++i)
         {
-            KeyManager::update(e);
-            MouseManager::update(e);
+            int line = i%amount;
+            FontParameter& param = lines[i];
+            param.text = variants == 1 ? "Label " + std::to_string(line%distinct) : "Frame " + std::to_string(i/amount) + ", line " + std::to_string(line);
+            param.rect = glm::vec4(line%8*(screenWidth/8),line/8%40*(screenHeight/40),screenWidth/8,screenHeight/40);
+            param.color = glm::vec4(0,0,0,1);
+            param.z = line%4;
         }
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-
-
-        int dimen = 50;
-
-        /*int start = SDL_GetTicks();
-
-
-
-        for (int i = 0; i < instances; i++)
+        return lines;
+    };
+    const int textLines = 2000; //lines per version
+    std::vector<FontParameter> labels = makeText(textLines,1,500);
+    std::vector<FontParameter> changingText = makeText(textLines,16,textLines);
+    auto requestText = [&](const std::vector<FontParameter>& lines, int amount, int frame){
+        size_t first = frame%(lines.size()/textLines)*textLines;
+        for (int i = 0; i < amount; ++i)
         {
-            fillBytesVec(bytes,sizeof(TightTuple<char,short,int,float,bool>),'a',short(18),10,10.0f,true);
+            FontGlobals::tnr.requestWrite(lines[first + i]);
         }
-        int fillBytesTime = SDL_GetTicks() - start;
-        bytes.clear();
-
-        start = SDL_GetTicks();
-        for (int i = 0; i < instances; i++)
+    };
+    auto requestPolygons = [&](int amount, int frame){
+        for (int i = 0; i < amount; ++i)
         {
-            TightTuple tuple('a',short(18),10,10.0f,true);
-            char* cars = reinterpret_cast<char*>(&tuple);
-            bytes.insert(bytes.end(),cars, cars + sizeof(tuple));
+            glm::vec4 rect = gridRect(i);
+            glm::vec4 color = glm::vec4(i%3 == 0,i%3 == 1,i%3 == 2,1);
+            switch (i%3)
+            {
+            case 0:
+                PolyRender::requestRect(rect,color,true,(frame + i)*0.01,i%8);
+                break;
+            case 1:
+                PolyRender::requestNGon(16,glm::vec2(rect.x + dimen/2,rect.y + dimen/2),dimen/2,color,0,true,i%8,true);
+                break;
+            case 2:
+                PolyRender::requestLine(glm::vec4(rect.x,rect.y,rect.x + rect.z,rect.y + rect.a),color,i%8);
+                break;
+            }
         }
-        int tightTupleTime = SDL_GetTicks() - start;
+    };
+
+    std::unordered_map<std::string,std::function<void(int)>> requests = {
+        {"sprites",[&](int){
+            requestSprites(100000,1,1);
+            }},
+        {"distinctSprites",[&](int){
+            requestSprites(100000,256,1);
+            }},
+        {"zInterleaved",[&](int){
+            requestSprites(100000,2,512);
+            }},
+        {"text",[&](int frame){
+            requestText(labels,textLines,frame);
+            }},
+        {"changingText",[&](int frame){
+            requestText(changingText,textLines,frame);
+            }},
+        {"polygons",[&](int frame){
+            requestPolygons(30000,frame);
+            }},
+        {"circles",[&](int){
+            for (int i = 0; i < 30000; ++i)
+            {
+                glm::vec4 rect = gridRect(i);
+                glm::vec2 center = glm::vec2(rect.x + dimen/2,rect.y + dimen/2);
+                PolyRender::requestCircle(glm::vec4(0,1,0,1),center,dimen/2 - 2,i%3 == 0,i%8);
+            }
+            }},
+        {"panels",[&](int){
+            for (int i = 0; i < 20000; ++i)
+            {
+                glm::vec4 rect = gridRect(i);
+                panel.request(glm::vec4(rect.x,rect.y,dimen - i%16,dimen/2 + i%24),i%8);
+            }
+            }},
+        {"mixed",[&](int frame){
+            requestSprites(50000,16,8);
+            requestText(labels,300,frame);
+            requestPolygons(5000,frame);
+            }}
+    };
+    std::vector<Scenario> scenarios;
+    for (auto& scenario : scenarioList)
+    {
+        scenarios.push_back({scenario.first,scenario.second,requests[scenario.first]});
+    }
 
-        std::cout << sizeof(TightTuple<char,short,int,float,bool>) << " " << tightTupleTime << " " << fillBytesTime << "\n";
-        bytes.clear();*/
+    std::time_t t = std::time(0);
+    std::tm* now = std::localtime(&t);
+    std::string date = std::to_string(now->tm_mon + 1) + "_" + std::to_string(now->tm_mday)+"_" + std::to_string(now->tm_year+1900);
 
-        for (int i = 0; i < instances; ++i)
+    std::vector<Result> results;
+    for (const Scenario& scenario : scenarios)
+    {
+        if (quit)
         {
-            //SpriteManager::requestSprite({*ViewPort::basicProgram,&sub},{i%(screenWidth/dimen)*dimen,i/(screenWidth/dimen)*dimen,dimen,dimen},0);
-            SpriteManager::request({*ViewPort::basicProgram,&sub},0,true,glm::vec4{i%(screenWidth/dimen)*dimen,i/(screenWidth/dimen)*dimen,dimen,dimen},0,0,0);
+            break;
         }
+        if (options.scenarios.size() == 0 || std::find(options.scenarios.begin(),options.scenarios.end(),scenario.name) != options.scenarios.end())
+        {
+            std::cout << "Running " << scenario.name << "..." << std::endl;
+            results.push_back(runScenario(scenario,options));
+            const Result& result = results.back();
+            std::cout << "  mean " << result.mean << " ms, p50 " << result.p50 << " ms, p95 " << result.p95 << " ms, p99 " << result.p99 << " ms, "
+                      << result.drawCalls << " draw calls, " << result.bytesUploaded << " bytes uploaded, "
+                      << result.bindsIssued << " binds issued (" << result.bindsSkipped << " skipped), " << result.allocations << " allocations per frame\n";
+            if (options.gpu)
+            {
+                GPUProfiler::dump(std::cout);
+            }
+        }
+    }
+    if (results.size() == 0)
+    {
+        std::cout << "No scenarios ran, see --list\n";
+        return 1;
+    }
 
-        //std::cout << old << " " << test << "\n";
-
-        //int
-
-        ViewPort::update();
-
-        //SpriteManager::trans.renderTest(instances);
-        SpriteManager::render();
-        PolyRender::render();
-
-        GLContext::update();
-        eventsEmpty = true;
-        DeltaTime::update();
-
-        //UNCOMMENT TO RECORD DATA
-        //benchmark << DeltaTime::deltaTime << "\n";
-
-        average += DeltaTime::deltaTime;
-        frames ++;
-        //std::cout << DeltaTime::deltaTime << "\n";
-        //Font::tnr.requestWrite({std::to_string(DeltaTime::deltaTime),glm::vec4(0,0,100,100),glm::vec4(1,0,0,1),0,1});
-
-        //SDL_Delay(std::max(0,10 - DeltaTime::deltaTime));
-
+    if (options.csv == "" && options.json == "")
+    {
+        options.csv = "data/benchmark_"+ date +"_" + std::to_string(time(0)) + ".csv";
+    }
+    if (options.csv != "")
+    {
+        std::ofstream csv(options.csv);
+        writeCSV(csv,results);
+        std::cout << "Wrote " << options.csv << "\n";
+    }
+    if (options.json != "")
+    {
+        std::ofstream json(options.json);
+        writeJSON(json,results,options,date);
+        std::cout << "Wrote " << options.json << "\n";
     }
     return 0;
 }
@@ -224,11 +224,12 @@ void BaseAnimationComponent::update()
     if (Entity* entity = getEntity())
     if (PositionalComponent* rect = entity->getComponent<PositionalComponent>())
     {
-        request(*ViewPort::animeProgram,rect->getBoundingRect(),zCoord,BaseAnimation::getFrameFromStart(start,anime),rect->getTilt());
-    }
-    if (start == 0)
-    {
-        start = SDL_GetTicks();
+        if (start == 0)
+        {
+            start = SDL_GetTicks();
+        }
+        //spriteSheetProgram works out the frame from "start" and the time in the UBO, so all we do is pass along the animation
+        request(*ViewPort::spriteSheetProgram,rect->getBoundingRect(),zCoord,anime.subSection,rect->getTilt(),anime.perRow,anime.rows,anime.fps,start);
     }
 }
 
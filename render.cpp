@@ -1,5 +1,12 @@
 #include <sstream>
 #include <fstream>
+#include <filesystem>
+#include <limits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -14,9 +21,9 @@
 bool GLContext::context = false;
 SDL_Window* GLContext::window = 0;
 
-void GLContext::init(int screenWidth, int screenHeight, bool fullscreen)
+void GLContext::init(int screenWidth, int screenHeight, bool fullscreen, bool hidden)
 {
-    window = SDL_CreateWindow("Project",SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,screenWidth, screenHeight, SDL_WINDOW_OPENGL | (fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0));
+    window = SDL_CreateWindow("Project",SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,screenWidth, screenHeight, SDL_WINDOW_OPENGL | (fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0) | (hidden ? SDL_WINDOW_HIDDEN : 0));
     SDL_GL_CreateContext(window);
     context = true;
 }
@@ -28,6 +35,8 @@ bool GLContext::isContextValid()
 
 void GLContext::update()
 {
+    GPUProfiler::endFrame();
+    StreamBuffer::endFrame(); //done writing for this frame, move onto the next StreamBuffer section
     SDL_GL_SwapWindow(window);
 }
 
@@ -59,26 +68,221 @@ void addPointToBuffer(float buffer[], glm::vec2 point, int index)
     addPointToBuffer(buffer, {point.x, point.y, 0}, index);
 }
 
-std::string glslTypesCaptureGroup = "(bool|int|float|vec([2-4])|mat([2-4]))"; //regex for capturing glsl types
-std::string findVertexInputsRgx = "layout \\(location = ([0-9]+)\\) in " + glslTypesCaptureGroup +" .+;\\s*"; //regex for vertex shader inputs
-Numbers getVertexInputs(const std::string& vertexFile)
+/*Hand written scanning for the few bits of GLSL we care about. These used to be regexes, and std::regex was most of our startup time. Each function
+matches exactly what its old regex did (including the parts that are arguably wrong, like only stripping "//" comments that have something in them),
+so every shader we have comes out the same. "." in the old regexes didn't match line breaks, hence isLineBreak*/
+static bool isLineBreak(char c)
 {
-    Numbers numbers;
-    regexSearch(findVertexInputsRgx,vertexFile,[&numbers](std::smatch& it){
-    std::string type = it[2];
-    if (type == "bool" || type == "int" || type == "float")
+    return c == '\n' || c == '\r';
+}
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static bool startsWith(const std::string& code, size_t pos, const char* prefix)
+{
+    return code.compare(pos,strlen(prefix),prefix) == 0;
+}
+
+//if there's a glsl type we can pass to a shader at "pos" followed by a space, returns how many floats it is and moves "pos" past the space. Otherwise returns 0
+static int matchType(const std::string& code, size_t& pos)
+{
+    int floats = 0;
+    size_t length = 0;
+    if (startsWith(code,pos,"bool"))
+    {
+        floats = 1;
+        length = 4;
+    }
+    else if (startsWith(code,pos,"int"))
+    {
+        floats = 1;
+        length = 3;
+    }
+    else if (startsWith(code,pos,"float"))
+    {
+        floats = 1;
+        length = 5;
+    }
+    else if ((startsWith(code,pos,"vec") || startsWith(code,pos,"mat")) && pos + 3 < code.size() && code[pos + 3] >= '2' && code[pos + 3] <= '4')
+    {
+        int size = code[pos + 3] - '0';
+        floats = code[pos] == 'v' ? size : size*size;
+        length = 4;
+    }
+    if (floats == 0 || pos + length >= code.size() || code[pos + length] != ' ')
+    {
+        return 0;
+    }
+    pos += length + 1;
+    return floats;
+}
+
+//finds the next "layout (location = N) in TYPE name;" at or after "from", along with any whitespace after it. Returns false if there isn't one
+static bool findVertexInput(const std::string& code, size_t from, size_t& begin, size_t& end, int& location, int& floats)
+{
+    const char* prefix = "layout (location = ";
+    for (size_t pos = code.find(prefix,from); pos != std::string::npos; pos = code.find(prefix,pos + 1))
+    {
+        size_t i = pos + strlen(prefix);
+        size_t digits = i;
+        while (i < code.size() && code[i] >= '0' && code[i] <= '9')
+        {
+            i++;
+        }
+        if (i == digits || !startsWith(code,i,") in "))
+        {
+            continue;
+        }
+        size_t type = i + 5;
+        int amount = matchType(code,type);
+        if (amount == 0)
+        {
+            continue;
+        }
+        //the rest of the line, up to its last semicolon
+        size_t lineEnd = std::min(code.find('\n',type),code.find('\r',type));
+        size_t semicolon = lineEnd == std::string::npos ? code.rfind(';') : (lineEnd > 0 ? code.rfind(';',lineEnd - 1) : std::string::npos);
+        if (semicolon == std::string::npos || semicolon <= type)
+        {
+            continue;
+        }
+        end = semicolon + 1;
+        while (end < code.size() && isSpace(code[end]))
+        {
+            end++;
+        }
+        begin = pos;
+        location = std::stoi(code.substr(digits,i - digits));
+        floats = amount;
+        return true;
+    }
+    return false;
+}
+
+//finds the next group of "KEYWORD TYPE name\n" lines (keyword is "in" or "out") at or after "from". "end" is right after the last line's line break
+static bool findDeclarations(const std::string& code, const char* keyword, size_t from, size_t& begin, size_t& end)
+{
+    auto matchLine = [&code,keyword](size_t pos){ //returns where the line ends (after the \n) or npos if there's no declaration at "pos"
+        if (!startsWith(code,pos,keyword) || code.compare(pos + strlen(keyword),1," ") != 0)
+        {
+            return std::string::npos;
+        }
+        size_t type = pos + strlen(keyword) + 1;
+        if (matchType(code,type) == 0)
+        {
+            return std::string::npos;
+        }
+        size_t lineEnd = type;
+        while (lineEnd < code.size() && !isLineBreak(code[lineEnd]))
+        {
+            lineEnd++;
+        }
+        if (lineEnd == type || lineEnd == code.size() || code[lineEnd] != '\n')
+        {
+            return std::string::npos;
+        }
+        return lineEnd + 1;
+    };
+    std::string search = std::string(keyword) + " ";
+    for (size_t pos = code.find(search,from); pos != std::string::npos; pos = code.find(search,pos + 1))
+    {
+        size_t lineEnd = matchLine(pos);
+        if (lineEnd != std::string::npos)
+        {
+            begin = pos;
+            do
+            {
+                end = lineEnd;
+                lineEnd = matchLine(end);
+            } while (lineEnd != std::string::npos);
+            return true;
+        }
+    }
+    return false;
+}
+
+//replaces every ${variable} with its config value. Unknown variables are left alone
+static std::string replaceVariables(const std::string& code)
+{
+    std::string answer;
+    answer.reserve(code.size());
+    size_t copied = 0;
+    for (size_t pos = code.find("${"); pos != std::string::npos; pos = code.find("${",pos + 1))
     {
-        numbers.push_back(1);
+        size_t lineEnd = pos + 2;
+        while (lineEnd < code.size() && !isLineBreak(code[lineEnd]))
+        {
+            lineEnd++;
+        }
+        size_t close = code.rfind('}',lineEnd - 1); //the old regex was greedy, so this is the last } on the line
+        if (close == std::string::npos || close < pos + 2)
+        {
+            continue;
+        }
+        std::string name = code.substr(pos + 2,close - pos - 2);
+        auto found = ResourcesConfig::config.find(name);
+        answer.append(code,copied,pos - copied);
+        answer += found == ResourcesConfig::config.end() ? code.substr(pos,close + 1 - pos) : found->second;
+        copied = close + 1;
+        pos = close; //loop adds 1
     }
-    else if (type.substr(0,3) == "vec")
+    answer.append(code,copied,std::string::npos);
+    return answer;
+}
+
+//finds the next #include "file"\n at or after "from". "fileName" is whatever was in the quotes
+static bool findInclude(const std::string& code, size_t from, size_t& begin, size_t& end, std::string& fileName)
+{
+    const char* prefix = "#include \"";
+    for (size_t pos = code.find(prefix,from); pos != std::string::npos; pos = code.find(prefix,pos + 1))
     {
-        numbers.push_back(std::stoi((it)[3]));
+        size_t start = pos + strlen(prefix);
+        //the old regex was ((.+/)*[^/]+)"\n. The first part can only end after a / on the same line, and it tries the last one first
+        std::vector<size_t> splits;
+        for (size_t i = start; i < code.size() && !isLineBreak(code[i]); ++i)
+        {
+            if (code[i] == '/' && i > start)
+            {
+                splits.push_back(i + 1);
+            }
+        }
+        splits.insert(splits.begin(),start);
+        for (auto it = splits.rbegin(); it != splits.rend(); ++it)
+        {
+            size_t split = *it;
+            size_t slash = code.find('/',split);
+            if (slash == std::string::npos)
+            {
+                slash = code.size();
+            }
+            //[^/]+ is greedy, so the quote is the last "\n before the next /
+            for (size_t quote = slash; quote > split + 2; --quote)
+            {
+                if (code[quote - 2] == '"' && code[quote - 1] == '\n')
+                {
+                    begin = pos;
+                    end = quote;
+                    fileName = code.substr(start,quote - 2 - start);
+                    return true;
+                }
+            }
+        }
     }
-    else if (type.substr(0,3) == "mat")
+    return false;
+}
+
+Numbers getVertexInputs(const std::string& vertexFile)
+{
+    Numbers numbers;
+    size_t begin = 0, end = 0;
+    int location = 0, floats = 0;
+    while (findVertexInput(vertexFile,end,begin,end,location,floats))
     {
-        numbers.push_back(pow(std::stoi((it)[3]),2));
+        numbers.push_back(floats);
     }
-    }); //replace environment variables
     return numbers;
 }
 
@@ -88,9 +292,9 @@ int loadShaders(const GLchar* source, GLenum shaderType, Numbers* numbers )
     return loadShaders({source,shaderType},numbers);
 }
 
-int loadShaders(LoadShaderInfo&& info, Numbers* numbers)
+std::pair<std::string,bool> preprocessShader(const LoadShaderInfo& info)
 {
-    std::string* shaderCode = nullptr;
+    const std::string* source = nullptr;
     std::pair<std::string, bool> result;
     //std::cout << info.isFilePath << " " << info.code << "\n";
     if (info.isFilePath)
@@ -99,78 +303,65 @@ int loadShaders(LoadShaderInfo&& info, Numbers* numbers)
 
         if (result.second)
         {
-            shaderCode = &result.first;
+            source = &result.first;
         }
         else
         {
             std::cerr << "Can't find shader! Source: " << info.code << std::endl;
-            return -1;
+            return {"",false};
         }
     }
     else
     {
-        shaderCode = &info.code;
+        source = &info.code;
     }
 
     //strip comments, makes processing easier
-    *shaderCode = stripComments(*shaderCode);
-
-    //lambda to replace environment variables.
-    auto lambda = [](std::string& str, const std::smatch& it){
-                std::string varName = (it)[1];
-                if (ResourcesConfig::config.find(varName) != ResourcesConfig::config.end())
-                {
-                    //std::cout << varName << " " << ResourcesConfig::config[varName] << "\n";
-                    return ResourcesConfig::config[varName];
-                    //std::cout << "ASDF: " << it[0] << " " << it.position(0)<< "\n";
-                }
-                return std::string(it[0]);
-                };
+    std::string strippedCode = stripComments(*source);
+    std::string* shaderCode = &strippedCode;
 
     //replace environment variables
-    std::string varDefRegex = "\\$\\{(.*)\\}"; //regex for finding variables ${variable_name}
-    std::regex reg = std::regex(varDefRegex);
-    *shaderCode = regexReplace(reg,*shaderCode,lambda);
+    *shaderCode = replaceVariables(*shaderCode);
 
-
-    //import include files
+    //import include files. Included code isn't searched for more includes
+    std::string withIncludes;
+    size_t copied = 0, begin = 0, end = 0;
+    std::string fileName;
     std::ifstream openIncludeFile;
-    *shaderCode = regexReplace(std::regex("#include \"((.+\/)*[^\/]+)\"\\n"),*shaderCode,[&openIncludeFile,&shaderCode,&info](std::string,std::smatch& it){
-                std::string fileName = it[1];//(*it)[2];
-                openIncludeFile.open(fileName);
-                if (openIncludeFile.is_open())
-                {
-                    std::stringstream stream;
-                    stream << openIncludeFile.rdbuf();
-                    openIncludeFile.close();
-                    return stream.str();
-                }
-                else
-                {
-                    openIncludeFile.close();
-                    std::cerr << "Error loading shader " << (info.isFilePath ? info.code : "Unknown Shader") << ": Failed to find open include file " << fileName << std::endl;
-                    throw std::logic_error("Error loading shader");
-                    return std::string();
-
-                }
-                });
-    //replace environment variables inside include files
-    *shaderCode = regexReplace(reg,*shaderCode,lambda);
-
-    //get vertex shader inputs
-    if (info.shaderType == GL_VERTEX_SHADER && numbers)
+    while (findInclude(*shaderCode,copied,begin,end,fileName))
     {
-        *numbers = getVertexInputs(*shaderCode);
+        withIncludes.append(*shaderCode,copied,begin - copied);
+        openIncludeFile.open(fileName);
+        if (openIncludeFile.is_open())
+        {
+            std::stringstream stream;
+            stream << openIncludeFile.rdbuf();
+            openIncludeFile.close();
+            withIncludes += stream.str();
+        }
+        else
+        {
+            openIncludeFile.close();
+            std::cerr << "Error loading shader " << (info.isFilePath ? info.code : "Unknown Shader") << ": Failed to find open include file " << fileName << std::endl;
+            throw std::logic_error("Error loading shader");
+        }
+        copied = end;
     }
+    withIncludes.append(*shaderCode,copied,std::string::npos);
 
-    //actually create and compile the shader
-    GLuint shader = glCreateShader(info.shaderType);
+    //replace environment variables inside include files
+    *shaderCode = replaceVariables(withIncludes);
 
+    return {*shaderCode,true};
+}
 
-    //std::cout << *shaderCode << "\n";
+int compileShader(const std::string& code, GLenum shaderType, const std::string& name)
+{
+    //actually create and compile the shader
+    GLuint shader = glCreateShader(shaderType);
 
-    const char* code = shaderCode->c_str();
-    glShaderSource(shader,1, &code, NULL);
+    const char* codePtr = code.c_str();
+    glShaderSource(shader,1, &codePtr, NULL);
     glCompileShader(shader);
 
     //check for errors with the compilation process
@@ -181,7 +372,7 @@ int loadShaders(LoadShaderInfo&& info, Numbers* numbers)
     {
         glGetShaderInfoLog(shader, 512, NULL, infoLog);
         std::cout << code << "\n";
-        std::cerr << "Error loading shader " << (info.isFilePath ? info.code : "Unknown Shader") << ": " << infoLog << " " << code << std::endl;
+        std::cerr << "Error loading shader " << name << ": " << infoLog << " " << code << std::endl;
         return -1;
     }
 
@@ -189,6 +380,154 @@ int loadShaders(LoadShaderInfo&& info, Numbers* numbers)
 
 }
 
+int loadShaders(LoadShaderInfo&& info, Numbers* numbers)
+{
+    std::pair<std::string,bool> code = preprocessShader(info);
+    if (!code.second)
+    {
+        return -1;
+    }
+
+    //get vertex shader inputs
+    if (info.shaderType == GL_VERTEX_SHADER && numbers)
+    {
+        *numbers = getVertexInputs(code.first);
+    }
+
+    return compileShader(code.first,info.shaderType,info.isFilePath ? info.code : "Unknown Shader");
+}
+
+bool ProgramCache::isEnabled()
+{
+    if (ResourcesConfig::config.find(ResourcesConfig::PROGRAM_CACHE_DIR) == ResourcesConfig::config.end() || !GLEW_ARB_get_program_binary)
+    {
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&formats);
+    return formats > 0; //some drivers support the extension but no formats
+}
+
+//FNV-1a, since std::hash isn't guaranteed to be the same between runs. Pass in the last hash to keep adding to it
+static uint64_t hashBytes(const char* bytes, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ (unsigned char)bytes[i])*1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t ProgramCache::getKey(const std::vector<LoadShaderInfo>& sources)
+{
+    uint64_t hash = hashBytes(nullptr,0);
+    auto add = [&hash](const char* bytes, size_t size){
+        hash = hashBytes(bytes,size,hash);
+    };
+    GLenum strings[3] = {GL_VENDOR,GL_RENDERER,GL_VERSION};
+    for (GLenum name : strings)
+    {
+        const char* string = reinterpret_cast<const char*>(glGetString(name));
+        if (string)
+        {
+            add(string,strlen(string) + 1); //include the null so "ab" + "c" and "a" + "bc" hash differently
+        }
+    }
+    for (const LoadShaderInfo& source : sources)
+    {
+        add(reinterpret_cast<const char*>(&source.shaderType),sizeof(source.shaderType));
+        add(source.code.c_str(),source.code.size() + 1);
+    }
+    return hash;
+}
+
+std::string ProgramCache::getPath(uint64_t key)
+{
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx.bin",(unsigned long long)key);
+    return ResourcesConfig::config[ResourcesConfig::PROGRAM_CACHE_DIR] + "/" + name;
+}
+
+bool ProgramCache::load(GLuint program, const std::vector<LoadShaderInfo>& sources, Numbers& numbers)
+{
+    if (!isEnabled())
+    {
+        return false;
+    }
+    uint64_t key = getKey(sources);
+    std::ifstream file(getPath(key),std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    //layout: key, number of inputs, the inputs, binary format, binary length, the binary
+    uint64_t fileKey = 0;
+    uint32_t inputs = 0, format = 0, length = 0;
+    file.read(reinterpret_cast<char*>(&fileKey),sizeof(fileKey));
+    file.read(reinterpret_cast<char*>(&inputs),sizeof(inputs));
+    if (!file || fileKey != key || inputs > 1024)
+    {
+        return false;
+    }
+    Numbers cachedNumbers(inputs);
+    file.read(reinterpret_cast<char*>(cachedNumbers.data()),inputs*sizeof(int));
+    file.read(reinterpret_cast<char*>(&format),sizeof(format));
+    file.read(reinterpret_cast<char*>(&length),sizeof(length));
+    if (!file)
+    {
+        return false;
+    }
+    std::vector<char> binary(length);
+    file.read(binary.data(),length);
+    if (!file)
+    {
+        return false;
+    }
+
+    glProgramBinary(program,format,binary.data(),length);
+    GLint success = 0;
+    glGetProgramiv(program,GL_LINK_STATUS,&success);
+    if (!success) //the driver can reject binaries for any reason, just compile it
+    {
+        return false;
+    }
+    numbers = cachedNumbers;
+    return true;
+}
+
+void ProgramCache::save(GLuint program, const std::vector<LoadShaderInfo>& sources, const Numbers& numbers)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program,GL_PROGRAM_BINARY_LENGTH,&length);
+    if (length <= 0)
+    {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program,length,nullptr,&format,binary.data());
+
+    uint64_t key = getKey(sources);
+    std::error_code error;
+    std::filesystem::create_directories(ResourcesConfig::config[ResourcesConfig::PROGRAM_CACHE_DIR],error);
+    std::ofstream file(getPath(key),std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        return;
+    }
+    uint32_t inputs = numbers.size(), format32 = format, length32 = length;
+    file.write(reinterpret_cast<const char*>(&key),sizeof(key));
+    file.write(reinterpret_cast<const char*>(&inputs),sizeof(inputs));
+    file.write(reinterpret_cast<const char*>(numbers.data()),inputs*sizeof(int));
+    file.write(reinterpret_cast<const char*>(&format32),sizeof(format32));
+    file.write(reinterpret_cast<const char*>(&length32),sizeof(length32));
+    file.write(binary.data(),length);
+}
+
 std::string templateShader(const std::string& shaderContents,
                            bool isVertex, //whether or not the shader is a vertex shader, determines the syntax of the inputs
                            std::initializer_list<std::string> inputs,
@@ -202,700 +541,2502 @@ std::string templateShader(const std::string& shaderContents,
     //and the there are no "holes" in the layouts, meaning if the largest layout number is 10, numbers 0-10 are all used. It is also expected that the layouts
     //are organized in numerical order, so that the last layout input has the largest index. If you're not organizing your code like this already you should
     //probably be put down. Finally, comments break this function. Please call stripComments first
-    std::string findLastInputRegex = isVertex ? "(" + findVertexInputsRgx + ")+" : //finds all the existing vertex inputs
-                                     "(in " + glslTypesCaptureGroup + " .+\\n)+";
-
-    std::string finalShader = "";
-    //handle inputs
-    regexSearch(findLastInputRegex,shaderContents,[&shaderContents,&finalShader,&inputs,isVertex](const std::smatch& it)
-                {
-                    int layout = 0; //largest layout parameter, only used for vertex shaders
 
+    //find the group of inputs. If there's more than one group, the last one is used
+    size_t end = 0; //where the new inputs go, right after the last input
+    int layout = 0; //largest layout parameter, only used for vertex shaders
+    bool found = false;
+    if (isVertex)
+    {
+        int location = 0, floats = 0;
+        size_t inputBegin = 0, inputEnd = 0;
+        while (findVertexInput(shaderContents,inputEnd,inputBegin,inputEnd,location,floats))
+        {
+            found = true;
+            end = inputEnd;
+            layout = location;
+        }
+    }
+    else
+    {
+        size_t groupBegin = 0, groupEnd = 0;
+        while (findDeclarations(shaderContents,"in",groupEnd,groupBegin,groupEnd))
+        {
+            end = groupEnd;
+            found = true;
+        }
+    }
+    if (!found)
+    {
+        return "";
+    }
 
-                    if (isVertex) //find the largest layout parameter
-                    {
-                        layout = std::stoi((it)[2]); //the 2nd capture group is the last number in the regex. Not sure how this works exactly but it seems to
-                    }
-
-                    int i = 1;
-                    for (auto input : inputs)
-                    {
-                        if (isVertex)
-                        {
-                            finalShader += "layout (location = " + std::to_string(layout + i) + ") ";
-                        }
-                        else if (input[0] == 'i' && input[1] == 'n' && input[2] == 't') //if our input is an int
-                        {
-                            finalShader += "flat ";//add "flat" keyword
-                        }
-                        finalShader += "in " + input + ";\n";
-                        i++;
-                    }
-                    finalShader = shaderContents.substr(0, it.position(0) + it.length()) + finalShader + shaderContents.substr(it.position(0) + it.length(), shaderContents.size());
-                });
+    //handle inputs
+    std::string newInputs = "";
+    int i = 1;
+    for (auto input : inputs)
+    {
+        if (isVertex)
+        {
+            newInputs += "layout (location = " + std::to_string(layout + i) + ") ";
+        }
+        else if (input[0] == 'i' && input[1] == 'n' && input[2] == 't') //if our input is an int
+        {
+            newInputs += "flat ";//add "flat" keyword
+        }
+        newInputs += "in " + input + ";\n";
+        i++;
+    }
+    std::string finalShader = shaderContents.substr(0,end) + newInputs + shaderContents.substr(end);
 
     //handle outputs now
-    regexSearch("(out " + glslTypesCaptureGroup + " .+\\n)+", finalShader,[&finalShader,&outputs](std::smatch& it){
-                    std::string newOutputs = "";
-                    for (auto output : outputs)
-                    {
-                        if (output[0] == 'i' && output[1] == 'n' && output[2] == 't') //if our input is an int
-                        {
-                            newOutputs += "flat ";//add "flat" keyword
-                        }
-                        newOutputs += "out " + output + ";\n";
-                    }
-                    finalShader = finalShader.substr(0, it.position(0) + it.length()) + newOutputs + finalShader.substr(it.position(0) + it.length(), finalShader.size());
-                } );
+    bool foundOutputs = false;
+    size_t outputBegin = 0, outputEnd = 0;
+    while (findDeclarations(finalShader,"out",outputEnd,outputBegin,outputEnd))
+    {
+        end = outputEnd;
+        foundOutputs = true;
+    }
+    if (foundOutputs)
+    {
+        std::string newOutputs = "";
+        for (auto output : outputs)
+        {
+            if (output[0] == 'i' && output[1] == 'n' && output[2] == 't') //if our input is an int
+            {
+                newOutputs += "flat ";//add "flat" keyword
+            }
+            newOutputs += "out " + output + ";\n";
+        }
+        finalShader = finalShader.substr(0,end) + newOutputs + finalShader.substr(end);
+    }
 
-    //modify the main function
-     regexSearch("void main\\(\\)\\s*\\{([\\s\\S]*)\\}", finalShader,[&finalShader,&tasks](std::smatch& it){
-                    std::string newTasks = "";
-                    for (auto task : tasks)
-                    {
-                        newTasks += task + ";\n"; //no need to provide semicolons, we provide them for you!
-                    }
-                    finalShader = finalShader.substr(0, it.position(1) + it.length(1)) + "\n" + newTasks + finalShader.substr(it.position(1) + it.length(1), finalShader.size());
-                } );
+    //modify the main function. Tasks go right before the last closing brace
+    for (size_t mainPos = finalShader.find("void main()"); mainPos != std::string::npos; mainPos = finalShader.find("void main()",mainPos + 1))
+    {
+        size_t brace = mainPos + strlen("void main()");
+        while (brace < finalShader.size() && isSpace(finalShader[brace]))
+        {
+            brace++;
+        }
+        size_t last = finalShader.rfind('}');
+        if (brace < finalShader.size() && finalShader[brace] == '{' && last != std::string::npos && last > brace)
+        {
+            std::string newTasks = "";
+            for (auto task : tasks)
+            {
+                newTasks += task + ";\n"; //no need to provide semicolons, we provide them for you!
+            }
+            finalShader = finalShader.substr(0,last) + "\n" + newTasks + finalShader.substr(last);
+            break;
+        }
+    }
     return finalShader;
 }
 
 std::string stripComments(const std::string& shaderContents)
 {
-    return std::regex_replace (shaderContents,std::regex("\\/\\/.+\\n"),"\n");
+    //removes every "//" comment that has at least one character in it and ends in a \n
+    std::string answer;
+    answer.reserve(shaderContents.size());
+    size_t copied = 0;
+    size_t pos = shaderContents.find("//");
+    while (pos != std::string::npos)
+    {
+        size_t lineEnd = pos + 2;
+        while (lineEnd < shaderContents.size() && !isLineBreak(shaderContents[lineEnd]))
+        {
+            lineEnd++;
+        }
+        if (lineEnd == shaderContents.size())
+        {
+            break;
+        }
+        if (shaderContents[lineEnd] == '\n' && lineEnd > pos + 2)
+        {
+            answer.append(shaderContents,copied,pos - copied);
+            answer += "\n";
+            copied = lineEnd + 1;
+            pos = shaderContents.find("//",copied);
+        }
+        else
+        {
+            pos = shaderContents.find("//",lineEnd);
+        }
+    }
+    answer.append(shaderContents,copied,std::string::npos);
+    return answer;
 
 }
 
 
-BasicRenderPipeline::BasicRenderPipeline(std::string vertexPath, std::string fragmentPath, const DivisorStorage& divisors_, const float* verts, int floatsPerVertex_ , int vertexAmount_) : BasicRenderPipeline({{vertexPath,GL_VERTEX_SHADER},{fragmentPath,GL_FRAGMENT_SHADER}},
-                                                                                                                                                                                            divisors_,verts,floatsPerVertex_,vertexAmount_)
-{
+bool StreamBuffer::enabled = true;
+GLsync StreamBuffer::fences[StreamBuffer::FRAMES] = {};
+int StreamBuffer::frame = 0;
+unsigned long long StreamBuffer::frameCount = 0;
 
+bool StreamBuffer::isSupported()
+{
+    return enabled && GLEW_ARB_buffer_storage;
 }
 
-void BasicRenderPipeline::bufferPayload(RenderPayload& payload)
+void StreamBuffer::endFrame()
 {
-    glBindVertexArray(VAO);
-    for (auto it = payload.begin(); it != payload.end(); ++it)
+    //the GPU is done with this section once everything submitted up to now has finished
+    if (fences[frame])
     {
-        glBindBuffer(GL_ARRAY_BUFFER,getVBO(it->first));
-        //std::cout << it->first << " " << getTotalFloats(it->second,it->first,vertexAmount)<< " " << it->second.bytes.size() << "\n";
-        //std::cout << (float)it->second.bytes[0] << "\n";
-        glBufferData(GL_ARRAY_BUFFER,it->second.size(),&it->second[0],GL_DYNAMIC_DRAW);
+        glDeleteSync(fences[frame]);
     }
-}
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
 
-int BasicRenderPipeline::getDivisor(unsigned int index)
-{
-    if (index >= divisors.size())
+    frame = (frame + 1)%FRAMES;
+    frameCount++;
+
+    //make sure the GPU is done reading the section we are about to write into. With 3 sections this almost never actually waits
+    if (fences[frame])
     {
-        return 1;
+        GLenum result = glClientWaitSync(fences[frame],0,0);
+        while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED)
+        {
+            result = glClientWaitSync(fences[frame],GL_SYNC_FLUSH_COMMANDS_BIT,1000000); //1 ms
+        }
+        glDeleteSync(fences[frame]);
+        fences[frame] = 0;
     }
-    return divisors[index];
 }
 
-void BasicRenderPipeline::setMatrix4fv(std::string name, const GLfloat* value)
+int StreamBuffer::getFrame()
 {
-    glUseProgram(program);
-    glUniformMatrix4fv(glGetUniformLocation(program,name.c_str()),1,GL_FALSE,value);
-    glUseProgram(0);
+    return frame;
 }
-void BasicRenderPipeline::setVec3fv(std::string name,glm::vec3 value)
+
+unsigned long long StreamBuffer::getFrameCount()
 {
-    glUseProgram(program);
-    glUniform3fv(glGetUniformLocation(program,name.c_str()),1,glm::value_ptr(value));
-    glUseProgram(0);
+    return frameCount;
 }
-void BasicRenderPipeline::setVec4fv(std::string name,glm::vec4 value)
+
+void StreamBuffer::init(size_t sectionBytes)
 {
-    glUseProgram(program);
-    glUniform4fv(glGetUniformLocation(program,name.c_str()),1,glm::value_ptr(value));
-    glUseProgram(0);
+    if (VBO)
+    {
+        GLState::deleteBuffer(VBO); //also unmaps
+    }
+    capacity = sectionBytes;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT; //coherent so we don't have to flush before every draw
+
+    glGenBuffers(1,&VBO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER,VBO);
+    glBufferStorage(GL_ARRAY_BUFFER,capacity*FRAMES,nullptr,flags);
+    mapped = static_cast<char*>(glMapBufferRange(GL_ARRAY_BUFFER,0,capacity*FRAMES,flags));
+    GLState::bindBuffer(GL_ARRAY_BUFFER,0);
 }
-void BasicRenderPipeline::setVec2fv(std::string name, glm::vec2 value)
+
+char* StreamBuffer::getSection()
 {
-    glUseProgram(program);
-    glUniform2fv(glGetUniformLocation(program,name.c_str()),1,glm::value_ptr(value));
-    glUseProgram(0);
+    return mapped + getSectionOffset();
 }
 
-size_t BasicRenderPipeline::getBytesPerRequest()
+size_t StreamBuffer::getSectionOffset()
 {
-    return dataAmount;
+    return frame*capacity;
 }
 
-Buffer BasicRenderPipeline::getProgram()
+size_t StreamBuffer::getCapacity()
 {
-    return program;
+    return capacity;
 }
 
-Buffer BasicRenderPipeline::getVBO(int divisor)
+Buffer StreamBuffer::getVBO()
 {
-    return vbos[divisor].VBO;
+    return VBO;
 }
 
-Buffer BasicRenderPipeline::getVAO()
-{
-    return VAO;
-}
+unsigned long long RenderCounters::drawCalls = 0;
+unsigned long long RenderCounters::bytesUploaded = 0;
+unsigned long long RenderCounters::bindsIssued = 0;
+unsigned long long RenderCounters::bindsSkipped = 0;
 
-Buffer BasicRenderPipeline::getVerticies()
+void RenderCounters::reset()
 {
-    return verticies;
+    drawCalls = 0;
+    bytesUploaded = 0;
+    bindsIssued = 0;
+    bindsSkipped = 0;
 }
 
-void BasicRenderPipeline::packData(RenderPayload& payload, char* bytes)
+GLuint GLState::program = GLState::UNKNOWN;
+GLuint GLState::VAO = GLState::UNKNOWN;
+GLuint GLState::arrayBuffer = GLState::UNKNOWN;
+GLuint GLState::uniformBuffer = GLState::UNKNOWN;
+GLuint GLState::activeUnit = GLState::UNKNOWN;
+GLuint GLState::textures[GLState::TEXTURE_UNITS][2];
+GLuint GLState::blend = GLState::UNKNOWN;
+
+bool GLState::changed(GLuint& current, GLuint value)
 {
-    int currentByte = 0;
-    int i = 1;
-    for (; i < divisors.size(); ++i)
+    if (current == value)
     {
-        Bytes* ptr = &payload[getDivisor(i)];
-        size_t totalSize = numbers[i]*sizeof(float);
-        ptr->insert(ptr->end(), &bytes[currentByte] , &bytes[currentByte] + totalSize);
-        currentByte += totalSize;
+        RenderCounters::bindsSkipped++;
+        return false;
     }
-    if (i < numbers.size()) //this only happens if the rest of our divisors are all 1, so just copy the rest of the data into the data for divisor 1
+    current = value;
+    RenderCounters::bindsIssued++;
+    return true;
+}
+
+void GLState::useProgram(GLuint program_)
+{
+    if (changed(program,program_))
     {
-        payload[1].insert(payload[1].end(),&bytes[currentByte],&bytes[currentByte]+vbos[1].floatsPerVertex*sizeof(float) - currentByte);
+        glUseProgram(program_);
     }
 }
 
-void BasicRenderPipeline::initVerticies(const float* verts, int floatsPerVertex_ , int vertexAmount_)
+void GLState::bindVertexArray(GLuint VAO_)
 {
-    if (verts && floatsPerVertex_ > 0 && vertexAmount_ > 0)
+    if (changed(VAO,VAO_))
     {
-        glBindVertexArray(VAO);
-        glGenBuffers(1,&verticies);
-        glBindBuffer(GL_ARRAY_BUFFER,verticies);
-
-        glBufferData(GL_ARRAY_BUFFER, floatsPerVertex_*vertexAmount_*sizeof(float),verts, GL_STATIC_DRAW);
-
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0,floatsPerVertex_,GL_FLOAT,GL_FALSE,0,0);
+        glBindVertexArray(VAO_);
     }
 }
 
-void BasicRenderPipeline::initAttribDivisors(Numbers numbers)
+void GLState::bindBuffer(GLenum target, GLuint buffer)
 {
-    int total = 0;
-    for (int i = 1; i < numbers.size(); ++i)
+    GLuint* current = target == GL_ARRAY_BUFFER ? &arrayBuffer : target == GL_UNIFORM_BUFFER ? &uniformBuffer : nullptr;
+    if (!current)
     {
-        int divisor = getDivisor(i);
-        vbos[divisor].floatsPerVertex += numbers[i];
-        glGenBuffers(1,&vbos[divisor].VBO);
-        total += numbers[i]*(divisor == 0 ? vertexAmount : 1); //if an attribute is per vertex, then it needs to be provided once per vertex
+        RenderCounters::bindsIssued++;
+        glBindBuffer(target,buffer);
     }
-    dataAmount = total*sizeof(GLfloat);
-    glBindVertexArray(VAO);
-
-    int index = 1; //we start at 1 because RenderProgram uses index 0 to store verticies
-    std::unordered_map<int,int> aggregates; //how many floats we've put in for each divisor
-    while (index < numbers.size()) //we skip the first input, assuming it is the vertex. If your vertex shader's first input is not verticies, this function will not work
+    else if (changed(*current,buffer))
     {
-        int num = numbers[index]; //number of floats for this vertex
-        for (int i = 0; i < num; i+= 4) //usually this only runs once, but if you have something that's larger than 4 floats (matricies) this will pass in every 4 floats in
-        {
-            int amount = std::min(num-i,4); //can't store larger than a vec4 at a time
-            int divisor = getDivisor(index - i/4);
-            glBindBuffer(GL_ARRAY_BUFFER,vbos[divisor].VBO);
-            //std::cout << num << " " << divisor << "\n";
-            glVertexAttribPointer(index, amount, GL_FLOAT, GL_FALSE,(vbos[divisor].floatsPerVertex)*sizeof(float), (void*)(aggregates[divisor]*sizeof(float)));
-            glEnableVertexAttribArray(index);
-            glVertexAttribDivisor(index, divisor);
-
-            index ++;
-            aggregates[divisor] += amount;
-
-        }
+        glBindBuffer(target,buffer);
     }
 }
 
-void BasicRenderPipeline::packDataHelper(RenderPayload& payload, int divisorsIndex, int vertexIndex)
+void GLState::bindTexture(GLenum target, GLuint texture, int unit)
 {
-    if (divisorsIndex < numbers.size()) //for each divisor that we didn't fully fill up, fill with 0s
+    if (changed(activeUnit,unit))
     {
-        //std::cout << divisorsIndex << " " << numbers[divisorsIndex] << "\n";
-        std::vector<char>* bytes = &(payload[getDivisor(divisorsIndex)]);
-        bytes->insert(bytes->end(),numbers[divisorsIndex]*(vertexAmount - vertexIndex)*sizeof(float),0);
-        packDataHelper(payload,divisorsIndex+1,std::max(1,getDivisor(divisorsIndex+1)*vertexAmount-1) );
-
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    int index = target == GL_TEXTURE_2D ? 0 : target == GL_TEXTURE_2D_ARRAY ? 1 : -1;
+    if (index == -1 || unit >= TEXTURE_UNITS)
+    {
+        RenderCounters::bindsIssued++;
+        glBindTexture(target,texture);
+    }
+    else if (changed(textures[unit][index],texture))
+    {
+        glBindTexture(target,texture);
     }
 }
 
-RenderCamera* ViewPort::currentCamera = nullptr;
-Buffer ViewPort::UBO = 0;
-UBOContents ViewPort::uniforms;
-int ViewPort::screenWidth = 0;
-int ViewPort::screenHeight = 0;
-ViewPort::PROJECTION_TYPE ViewPort::proj = ORTHOGRAPHIC;
-
-ViewRange ViewPort::baseRange;
-ViewRange ViewPort::currentRange;
-
-std::unique_ptr<RenderProgram> ViewPort::basicProgram;
-std::unique_ptr<RenderProgram> ViewPort::animeProgram;
-
-
-void ViewPort::init(int screenWidth, int screenHeight)
+void GLState::setBlend(bool enabled)
 {
-    ViewPort::screenWidth = screenWidth;
-    ViewPort::screenHeight = screenHeight;
-
-    glewExperimental = true;
-
-    GLenum err=glewInit();
-      if(err!=GLEW_OK) {
-        // Problem: glewInit failed, something is seriously wrong.
-        std::cout << "glewInit failed: " << glewGetErrorString(err) << std::endl;
-      }
-
-    baseRange =
+    if (changed(blend,enabled))
     {
-        {0,screenWidth},
-        {0,screenHeight},
-        {0.0f,100.0f}     //magic numbers. Can be anything for orthographic views but perspective views will clamp the x value to 0.1, as it must be positive
-    };
-    currentRange = baseRange;
-
-glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
-    glEnable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_PRIMITIVE_RESTART);
-
-    glDepthFunc(GL_LEQUAL);
-
-
-
-    basicProgram = std::make_unique<RenderProgram>(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/betterShader.h",
-                      ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/fragmentShader.h");
-    animeProgram = std::make_unique<RenderProgram>(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/animationShader.h",
-                      ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/fragmentShader.h");
-
-    resetUniforms();
-
-    glGenBuffers(1,&UBO);
-    glBindBuffer(GL_UNIFORM_BUFFER,UBO);
-    glBufferData(GL_UNIFORM_BUFFER,sizeof(UBOContents),nullptr, GL_STATIC_DRAW); // allocate enough memory for our UBO
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, UBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-
+        enabled ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+    }
 }
 
-
-glm::vec4 RenderCamera::toScreen(const glm::vec4& change) const
+bool GLState::isBlending()
 {
-        //REFACTOR: Finish this for perspective mode
-
-    glm::vec2 point = toScreen({change.x,change.y});
-    return {point.x,point.y,change.z, change.a};
+    if (blend == UNKNOWN)
+    {
+        blend = glIsEnabled(GL_BLEND);
+    }
+    return blend;
 }
 
-glm::vec2 RenderCamera::toScreen(const glm::vec2& point) const
+void GLState::deleteBuffer(GLuint buffer)
 {
-    //REFACTOR: Finish this for perspective mode
-
-    return (point - getTopLeft())/glm::vec2(ViewPort::getViewWidth(),ViewPort::getViewHeight())*ViewPort::getScreenDimen();
+    glDeleteBuffers(1,&buffer);
+    if (arrayBuffer == buffer)
+    {
+        arrayBuffer = 0;
+    }
+    if (uniformBuffer == buffer)
+    {
+        uniformBuffer = 0;
+    }
 }
 
-glm::vec4 RenderCamera::toWorld(const glm::vec4& change, ZType z) const
+void GLState::deleteTexture(GLuint texture)
 {
-    //REFACTOR: Finish this for perspective mode
-
-    glm::vec2 point = toWorld({change.x,change.y});
-    return {point.x,point.y , change.z, change.a};
-}
-
-glm::vec2 RenderCamera::toWorld(const glm::vec2& point,ZType z) const
-{    //REFACTOR: Finish this for perspective mode
-    glm::vec2 screenDimen = ViewPort::getScreenDimen();
-
-    if (ViewPort::getProj() == ViewPort::PERSPECTIVE)
+    glDeleteTextures(1,&texture);
+    for (int i = 0; i < TEXTURE_UNITS; ++i)
     {
-        float screenHeight = 2*( getPos().z - z)*(tan(glm::radians(ViewPort::FOV/2)));
-        float screenWidth = screenHeight/screenDimen.y*screenDimen.x;
-        return glm::vec2(getPos()) + glm::vec2((point.x - screenDimen.x/2)/screenDimen.x*screenWidth, ((point.y - screenDimen.y/2)/screenDimen.y*screenHeight));
+        for (int j = 0; j < 2; ++j)
+        {
+            if (textures[i][j] == texture)
+            {
+                textures[i][j] = 0;
+            }
+        }
     }
-
-
-    return getTopLeft()+ glm::vec2((point.x)/screenDimen.x*ViewPort::getViewWidth(), ((point.y)/screenDimen.x*ViewPort::getViewHeight()));
 }
 
-glm::vec4 RenderCamera::toAbsolute(const glm::vec4& rect) const
+void GLState::invalidate()
 {
-    if (ViewPort::getProj() == ViewPort::PERSPECTIVE)
+    program = UNKNOWN;
+    VAO = UNKNOWN;
+    arrayBuffer = UNKNOWN;
+    uniformBuffer = UNKNOWN;
+    activeUnit = UNKNOWN;
+    blend = UNKNOWN;
+    for (int i = 0; i < TEXTURE_UNITS; ++i)
     {
-        //returns toAbsolute if rect is rendered as close to the camera as possible
-        glm::vec2 screenDimen = ViewPort::getScreenDimen();
-
-        float screenHeight = (ViewPort::getZRange().x + 1)*2*(tan(glm::radians(ViewPort::FOV/2)));
-        float screenWidth = screenHeight/screenDimen.y*screenDimen.x;
-
-        return glm::vec4(-screenWidth + pos.x + (rect.x)/screenDimen.x*screenWidth,
-                -screenHeight + pos.y + (rect.y)/screenDimen.y*screenHeight,
-                rect.z/screenDimen.x*screenWidth,
-                rect.a/screenDimen.y*screenHeight);
+        textures[i][0] = UNKNOWN;
+        textures[i][1] = UNKNOWN;
     }
-    return glm::vec4(getTopLeft() + glm::vec2(rect.x,rect.y),rect.z,rect.a);
-}
-glm::vec2 RenderCamera::toAbsolute(const glm::vec2& point) const
-{
-    glm::vec4 rect = toAbsolute(glm::vec4(point,0,0));
-    return {rect.x,rect.y};
-}
-glm::vec2 ViewPort::toAbsolute(const glm::vec2& point)
-{
-    return currentCamera ? currentCamera->toAbsolute(point) : point;
-}
-glm::vec4 ViewPort::toAbsolute(const glm::vec4& rect)
-{
-    return currentCamera ? currentCamera->toAbsolute(rect) : rect;
 }
 
-glm::vec2 ViewPort::toWorld(const glm::vec2& point, ZType z)
+bool GPUProfiler::enabled = false;
+std::vector<GPUProfiler::Pending> GPUProfiler::pending[GPUProfiler::LATENCY];
+std::vector<GLuint> GPUProfiler::pool;
+GLuint GPUProfiler::timestamps[GPUProfiler::LATENCY] = {};
+bool GPUProfiler::timestamped[GPUProfiler::LATENCY] = {};
+GLuint64 GPUProfiler::lastTimestamp = 0;
+int GPUProfiler::frame = 0;
+bool GPUProfiler::active = false;
+std::map<int,GPUProfiler::Stats> GPUProfiler::stats;
+std::map<int,std::string> GPUProfiler::names;
+double GPUProfiler::frameMs = 0;
+unsigned long long GPUProfiler::framesRead = 0;
+std::vector<double> GPUProfiler::frameTimes;
+std::vector<int> GPUProfiler::frameIDs;
+
+bool GPUProfiler::isSupported()
 {
-    return currentCamera ? currentCamera->toWorld(point,z) : point;
+    return GLEW_ARB_timer_query;
 }
 
-glm::vec4 ViewPort::toWorld(const glm::vec4& rect, ZType z)
+void GPUProfiler::begin(int id)
 {
-    return glm::vec4(toWorld({rect.x,rect.y},z),rect.z,rect.a);
+    if (!enabled || active || !isSupported())
+    {
+        return;
+    }
+    GLuint query = 0;
+    if (pool.size() > 0)
+    {
+        query = pool.back();
+        pool.pop_back();
+    }
+    else
+    {
+        glGenQueries(1,&query);
+    }
+    glBeginQuery(GL_TIME_ELAPSED,query);
+    pending[frame].push_back({query,id});
+    active = true;
 }
 
-glm::vec2 ViewPort::toScreen(const glm::vec2& point)
+void GPUProfiler::end()
 {
-    return currentCamera ? currentCamera->toScreen(point) : point;
+    if (active)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        active = false;
+    }
 }
 
-glm::vec4 ViewPort::toScreen(const glm::vec4& rect)
+void GPUProfiler::endFrame()
 {
-    return glm::vec4(toScreen({rect.x,rect.y}),rect.z,rect.a);
+    if (!isSupported())
+    {
+        return;
+    }
+    end(); //just in case
+    timestamped[frame] = enabled;
+    if (enabled)
+    {
+        if (!timestamps[0])
+        {
+            glGenQueries(LATENCY,timestamps);
+        }
+        glQueryCounter(timestamps[frame],GL_TIMESTAMP);
+    }
+
+    frame = (frame + 1)%LATENCY; //this is now the oldest frame, read it back so we can reuse its slot
+
+    if (pending[frame].size() > 0 || timestamped[frame])
+    {
+        for (auto it = pending[frame].begin(); it != pending[frame].end(); ++it)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(it->query,GL_QUERY_RESULT_AVAILABLE,&available);
+            if (available) //if it somehow isn't ready yet, drop it rather than stall
+            {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(it->query,GL_QUERY_RESULT,&elapsed);
+                size_t index = it->id - POLYGON_SHAPES;
+                if (index >= frameTimes.size())
+                {
+                    frameTimes.resize(index + 1,-1);
+                }
+                if (frameTimes[index] < 0) //first time this id shows up this frame
+                {
+                    frameTimes[index] = 0;
+                    frameIDs.push_back(it->id);
+                }
+                frameTimes[index] += elapsed/1000000.0;
+                stats[it->id].batches++;
+            }
+            pool.push_back(it->query);
+        }
+        pending[frame].clear();
+        for (int id : frameIDs)
+        {
+            double& time = frameTimes[id - POLYGON_SHAPES];
+            Stats& stat = stats[id];
+            stat.totalMs += time;
+            stat.lastFrameMs = time;
+            time = -1;
+        }
+        frameIDs.clear();
+
+        GLint available = 0;
+        if (timestamped[frame])
+        {
+            glGetQueryObjectiv(timestamps[frame],GL_QUERY_RESULT_AVAILABLE,&available);
+        }
+        if (available)
+        {
+            GLuint64 timestamp = 0;
+            glGetQueryObjectui64v(timestamps[frame],GL_QUERY_RESULT,&timestamp);
+            if (lastTimestamp)
+            {
+                frameMs = (timestamp - lastTimestamp)/1000000.0;
+            }
+            lastTimestamp = timestamp;
+        }
+        else
+        {
+            lastTimestamp = 0; //the next frame has nothing to measure from
+        }
+        framesRead++;
+        timestamped[frame] = false;
+    }
 }
 
-const glm::vec2& ViewPort::getXRange()
+void GPUProfiler::setName(int id, const std::string& name)
 {
-    return currentRange.xRange;
+    names[id] = name;
 }
-const glm::vec2& ViewPort::getYRange()
+
+const GPUProfiler::Stats* GPUProfiler::getStats(int id)
 {
-    return currentRange.yRange;
+    auto found = stats.find(id);
+    if (found == stats.end())
+    {
+        return nullptr;
+    }
+    return &found->second;
 }
-const glm::vec2& ViewPort::getZRange()
+
+double GPUProfiler::getTotalMs()
 {
-    return currentRange.zRange;
+    double total = 0;
+    for (auto it = stats.begin(); it != stats.end(); ++it)
+    {
+        total += it->second.totalMs;
+    }
+    return total;
 }
 
-const float ViewPort::getViewWidth()
+double GPUProfiler::getFrameMs()
 {
-    return currentRange.xRange.y - currentRange.xRange.x;
+    return frameMs;
 }
 
-const float ViewPort::getViewHeight()
+unsigned long long GPUProfiler::getFramesRead()
 {
-    return currentRange.yRange.y - currentRange.yRange.x;
+    return framesRead;
 }
 
-const float ViewPort::getViewDepth()
+void GPUProfiler::dump(std::ostream& stream)
 {
-    return currentRange.zRange.y - currentRange.zRange.x;
+    stream << "GPU frame ms: " << frameMs << "\n";
+    for (auto it = stats.begin(); it != stats.end(); ++it)
+    {
+        auto name = names.find(it->first);
+        stream << (name == names.end() ? "pipeline " + std::to_string(it->first) : name->second) << ": "
+               << it->second.totalMs << " ms total, "
+               << (framesRead > 0 ? it->second.totalMs/framesRead : 0) << " ms per frame, "
+               << it->second.batches << " batches\n";
+    }
 }
 
-void ViewPort::setXRange(float x1, float x2)
+void GPUProfiler::reset()
 {
-    setViewRange({
-                 {x1,x2},
-                 currentRange.yRange,
-                 currentRange.zRange
-                 });
+    stats.clear();
+    frameMs = 0;
+    framesRead = 0;
 }
-void ViewPort::setYRange(float y1, float y2)
+
+unsigned int BasicRenderPipeline::pipelines = 0;
+
+void BasicRenderPipeline::initProgram(LoadShaderInfo* info, size_t count)
 {
-    setViewRange({
-                 currentRange.xRange,
-                 {y1,y2},
-                 currentRange.zRange
-                 });
-}
-void ViewPort::setZRange(float z1, float z2)
+    program = glCreateProgram();
+
+    std::vector<LoadShaderInfo> sources; //preprocessed, so the cache key changes if an #include does
+    std::vector<std::string> names; //for error messages
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::pair<std::string,bool> code = preprocessShader(info[i]);
+        if (code.second)
+        {
+            sources.push_back({code.first,info[i].shaderType,false});
+            names.push_back(info[i].isFilePath ? info[i].code : "Unknown Shader");
+        }
+    }
+
+    if (!ProgramCache::load(program,sources,numbers))
+    {
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            if (sources[i].shaderType == GL_VERTEX_SHADER)
+            {
+                numbers = getVertexInputs(sources[i].code);
+            }
+            int shader = compileShader(sources[i].code,sources[i].shaderType,names[i]);
+            if (shader != -1)
+            {
+                glAttachShader(program,shader);
+                glDeleteShader(shader);
+            }
+        }
+        if (ProgramCache::isEnabled())
+        {
+            glProgramParameteri(program,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+        }
+        glLinkProgram(program);
+
+        GLint success = 0;
+        glGetProgramiv(program,GL_LINK_STATUS,&success);
+        if (success)
+        {
+            ProgramCache::save(program,sources,numbers);
+        }
+    }
+    ViewPort::linkUniformBuffer(program); //uniform block bindings can only be set once the program is linked
+    initUniforms();
+    UniformHandle discard = getUniform("discardBelow");
+    discardBelowLocation = discard == -1 ? -1 : uniforms[discard].location;
+}
+
+void BasicRenderPipeline::initUniforms()
+{
+    GLint count = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(program,GL_ACTIVE_UNIFORMS,&count);
+    glGetProgramiv(program,GL_ACTIVE_UNIFORM_MAX_LENGTH,&maxLength);
+    std::vector<char> name(maxLength + 1);
+    uniforms.clear();
+    uniformLookup.clear();
+    for (GLint i = 0; i < count; ++i)
+    {
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program,i,name.size(),nullptr,&size,&type,name.data());
+        GLint location = glGetUniformLocation(program,name.data());
+        if (location != -1) //uniforms in a block (like Matrices) don't have a location
+        {
+            Uniform uniform;
+            uniform.name = name.data();
+            if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3,3,"[0]") == 0)
+            {
+                uniform.name.resize(uniform.name.size() - 3);
+            }
+            uniform.location = location;
+            uniform.type = type;
+            uniformLookup[uniform.name] = uniforms.size();
+            uniforms.push_back(uniform);
+        }
+    }
+}
+
+BasicRenderPipeline::BasicRenderPipeline(std::string vertexPath, std::string fragmentPath, const DivisorStorage& divisors_, const float* verts, int floatsPerVertex_ , int vertexAmount_) : BasicRenderPipeline({{vertexPath,GL_VERTEX_SHADER},{fragmentPath,GL_FRAGMENT_SHADER}},
+                                                                                                                                                                                            divisors_,verts,floatsPerVertex_,vertexAmount_)
+{
+
+}
+
+GLuint BasicRenderPipeline::bufferPayload(RenderPayload& payload, int instances)
+{
+    GLState::bindVertexArray(VAO);
+    if (streaming && streamFrame != StreamBuffer::getFrameCount()) //new frame, start writing from the beginning of our section
+    {
+        streamFrame = StreamBuffer::getFrameCount();
+        streamCursor = 0;
+    }
+    if (streaming && streamCursor + instances > streamInstances) //not enough room left this frame, grow. Batches we've already drawn this frame are unaffected
+    {
+        initStreams(std::max(streamInstances*2,(size_t)instances));
+    }
+    for (size_t divisor = 0; divisor < payload.size(); ++divisor)
+    {
+        Bytes& bytes = payload[divisor];
+        if (bytes.size() == 0)
+        {
+            continue;
+        }
+        RenderCounters::bytesUploaded += bytes.size();
+        if (streaming && divisor != 0)
+        {
+            //write straight into mapped memory. Every divisor shares the same cursor so one base instance works for all of them
+            VBOInfo& info = vbos[divisor];
+            memcpy(info.stream.getSection() + streamCursor*info.floatsPerVertex*sizeof(float),&bytes[0],bytes.size());
+        }
+        else
+        {
+            GLState::bindBuffer(GL_ARRAY_BUFFER,getVBO(divisor));
+            glBufferData(GL_ARRAY_BUFFER,bytes.size(),&bytes[0],GL_DYNAMIC_DRAW);
+        }
+    }
+    if (streaming)
+    {
+        GLuint base = StreamBuffer::getFrame()*streamInstances + streamCursor; //our attributes point at the start of the buffer, so skip the previous sections too
+        streamCursor += instances;
+        return base;
+    }
+    return 0;
+}
+
+GLuint BasicRenderPipeline::beginBatch(int instances)
+{
+    if (streaming && streamFrame != StreamBuffer::getFrameCount())
+    {
+        streamFrame = StreamBuffer::getFrameCount();
+        streamCursor = 0;
+    }
+    if (streaming && streamCursor + instances > streamInstances)
+    {
+        initStreams(std::max(streamInstances*2,(size_t)instances));
+    }
+    for (size_t i = 0; i < copyTargets.size(); ++i)
+    {
+        CopyTarget& target = copyTargets[i];
+        target.streamed = streaming && target.divisor != 0;
+        if (target.streamed)
+        {
+            target.write = vbos[target.divisor].stream.getSection() + streamCursor*target.stride;
+            RenderCounters::bytesUploaded += instances*target.stride;
+        }
+        else
+        {
+            staging[i].resize(instances*target.stride);
+            target.write = staging[i].data();
+        }
+    }
+    batchInstances = instances;
+    if (streaming)
+    {
+        GLuint base = StreamBuffer::getFrame()*streamInstances + streamCursor;
+        streamCursor += instances;
+        return base;
+    }
+    return 0;
+}
+
+void BasicRenderPipeline::endBatch()
+{
+    for (size_t i = 0; i < copyTargets.size(); ++i)
+    {
+        if (!copyTargets[i].streamed && batchInstances > 0)
+        {
+            GLState::bindBuffer(GL_ARRAY_BUFFER,vbos[copyTargets[i].divisor].VBO);
+            glBufferData(GL_ARRAY_BUFFER,batchInstances*copyTargets[i].stride,staging[i].data(),GL_DYNAMIC_DRAW);
+            RenderCounters::bytesUploaded += batchInstances*copyTargets[i].stride;
+        }
+    }
+}
+
+void BasicRenderPipeline::drawInstanced(GLenum mode, int instances, GLuint baseInstance)
+{
+    RenderCounters::drawCalls++;
+    if (baseInstance == 0)
+    {
+        glDrawArraysInstanced(mode,0,vertexAmount,instances);
+    }
+    else
+    {
+        glDrawArraysInstancedBaseInstance(mode,0,vertexAmount,instances,baseInstance);
+    }
+}
+
+bool BasicRenderPipeline::isStreaming()
+{
+    return streaming;
+}
+
+void BasicRenderPipeline::setAtlased(bool atlased_)
+{
+    atlased = atlased_;
+}
+
+void BasicRenderPipeline::setDiscardBelow(float alpha)
+{
+    if (discardBelowLocation != -1 && alpha != discardBelow)
+    {
+        glUniform1f(discardBelowLocation,alpha);
+        discardBelow = alpha;
+    }
+}
+
+bool BasicRenderPipeline::canDiscard()
+{
+    return discardBelowLocation != -1;
+}
+
+bool BasicRenderPipeline::isAtlased()
+{
+    return atlased;
+}
+
+void BasicRenderPipeline::setOpaqueSafe(bool opaqueSafe_)
+{
+    opaqueSafe = opaqueSafe_;
+}
+
+bool BasicRenderPipeline::isOpaqueSafe()
+{
+    return opaqueSafe;
+}
+
+void BasicRenderPipeline::setDrawIDs(bool drawIDs_)
+{
+    drawIDs = false;
+    if (drawIDs_)
+    {
+        UniformHandle sprites = getUniform("sprites");
+        if (sprites == -1)
+        {
+            std::cerr << "BasicRenderPipeline::setDrawIDs: fragment shader has no \"sprites\" sampler array" << std::endl;
+            return;
+        }
+        //samplers never change, so they're set once here instead of going through the uniform table
+        GLint units[DRAW_TEXTURES];
+        for (int i = 0; i < DRAW_TEXTURES; ++i)
+        {
+            units[i] = i;
+        }
+        GLState::useProgram(program);
+        glUniform1iv(uniforms[sprites].location,DRAW_TEXTURES,units);
+        drawIDs = true;
+    }
+}
+
+bool BasicRenderPipeline::hasDrawIDs()
+{
+    return drawIDs;
+}
+
+void BasicRenderPipeline::initStreams(size_t instances)
+{
+    for (size_t divisor = 1; divisor < vbos.size(); ++divisor) //divisor 0 data is per vertex rather than per instance, so base instances can't offset it. Keep using glBufferData for those
+    {
+        VBOInfo& info = vbos[divisor];
+        if (info.floatsPerVertex > 0)
+        {
+            info.stream.init(instances*info.floatsPerVertex*sizeof(float));
+            info.VBO = info.stream.getVBO();
+        }
+    }
+    streamInstances = instances;
+    streamCursor = 0;
+    initAttribPointers();
+}
+
+int BasicRenderPipeline::getDivisor(unsigned int index)
+{
+    if (index >= divisors.size())
+    {
+        return 1;
+    }
+    return divisors[index];
+}
+
+void BasicRenderPipeline::use()
+{
+    GLState::useProgram(program);
+    for (UniformHandle handle : dirtyUniforms)
+    {
+        Uniform& uniform = uniforms[handle];
+        switch (uniform.type)
+        {
+        case GL_FLOAT:
+            glUniform1fv(uniform.location,1,uniform.value);
+            break;
+        case GL_FLOAT_VEC2:
+            glUniform2fv(uniform.location,1,uniform.value);
+            break;
+        case GL_FLOAT_VEC3:
+            glUniform3fv(uniform.location,1,uniform.value);
+            break;
+        case GL_FLOAT_VEC4:
+            glUniform4fv(uniform.location,1,uniform.value);
+            break;
+        case GL_FLOAT_MAT4:
+            glUniformMatrix4fv(uniform.location,1,GL_FALSE,uniform.value);
+            break;
+        }
+        uniform.dirty = false;
+    }
+    dirtyUniforms.clear();
+}
+
+UniformHandle BasicRenderPipeline::getUniform(const std::string& name)
+{
+    auto found = uniformLookup.find(name);
+    return found == uniformLookup.end() ? -1 : found->second;
+}
+
+void BasicRenderPipeline::setUniform(UniformHandle uniform, GLenum type, const float* value, int floats)
+{
+    if (uniform < 0 || (size_t)uniform >= uniforms.size()) //setting a uniform the shader doesn't have (or optimized out) has always been a no-op
+    {
+        return;
+    }
+    Uniform& target = uniforms[uniform];
+    if (target.type != type)
+    {
+        std::cerr << "BasicRenderPipeline::setUniform: wrong type for uniform " << target.name << std::endl;
+        return;
+    }
+    if (!target.set || memcmp(target.value,value,floats*sizeof(float)) != 0)
+    {
+        target.set = true;
+        memcpy(target.value,value,floats*sizeof(float));
+        if (!target.dirty)
+        {
+            target.dirty = true;
+            dirtyUniforms.push_back(uniform);
+        }
+    }
+}
+
+void BasicRenderPipeline::setMatrix4fv(UniformHandle uniform, const GLfloat* value)
+{
+    setUniform(uniform,GL_FLOAT_MAT4,value,16);
+}
+void BasicRenderPipeline::setVec3fv(UniformHandle uniform, glm::vec3 value)
+{
+    setUniform(uniform,GL_FLOAT_VEC3,glm::value_ptr(value),3);
+}
+void BasicRenderPipeline::setVec4fv(UniformHandle uniform, glm::vec4 value)
+{
+    setUniform(uniform,GL_FLOAT_VEC4,glm::value_ptr(value),4);
+}
+void BasicRenderPipeline::setVec2fv(UniformHandle uniform, glm::vec2 value)
+{
+    setUniform(uniform,GL_FLOAT_VEC2,glm::value_ptr(value),2);
+}
+void BasicRenderPipeline::setMatrix4fv(const std::string& name, const GLfloat* value)
+{
+    setMatrix4fv(getUniform(name),value);
+}
+void BasicRenderPipeline::setVec3fv(const std::string& name,glm::vec3 value)
+{
+    setVec3fv(getUniform(name),value);
+}
+void BasicRenderPipeline::setVec4fv(const std::string& name,glm::vec4 value)
+{
+    setVec4fv(getUniform(name),value);
+}
+void BasicRenderPipeline::setVec2fv(const std::string& name, glm::vec2 value)
+{
+    setVec2fv(getUniform(name),value);
+}
+
+size_t BasicRenderPipeline::getBytesPerRequest()
+{
+    return dataAmount;
+}
+
+unsigned int BasicRenderPipeline::getID()
+{
+    return id;
+}
+
+Buffer BasicRenderPipeline::getProgram()
+{
+    return program;
+}
+
+Buffer BasicRenderPipeline::getVBO(int divisor)
+{
+    if (divisor < 0 || (size_t)divisor >= vbos.size())
+    {
+        return 0;
+    }
+    return vbos[divisor].VBO;
+}
+
+Buffer BasicRenderPipeline::getVAO()
+{
+    return VAO;
+}
+
+Buffer BasicRenderPipeline::getVerticies()
+{
+    return verticies;
+}
+
+void BasicRenderPipeline::initCopyTable()
+{
+    copyTargets.clear();
+    copyTable.clear();
+    std::vector<int> targets(vbos.size(),-1); //divisor to index in "copyTargets"
+    std::vector<size_t> aggregates(vbos.size(),0); //how many floats of each divisor's data we've accounted for
+    size_t src = 0;
+    for (size_t i = 1; i < numbers.size(); ++i)
+    {
+        int divisor = getDivisor(i);
+        size_t vertexBytes = vbos[divisor].floatsPerVertex*sizeof(float);
+        if (targets[divisor] == -1)
+        {
+            CopyTarget target;
+            target.divisor = divisor;
+            target.stride = vertexBytes*(divisor == 0 ? vertexAmount : 1);
+            targets[divisor] = copyTargets.size();
+            copyTargets.push_back(target);
+        }
+        unsigned int target = targets[divisor];
+        size_t bytes = numbers[i]*sizeof(float);
+        int copies = (divisor == 0 ? vertexAmount : 1); //per vertex inputs are provided once per vertex, and interleaved with the other per vertex inputs
+        for (int j = 0; j < copies; ++j)
+        {
+            size_t dst = aggregates[divisor]*sizeof(float) + j*vertexBytes;
+            if (copyTable.size() > 0 && copyTable.back().target == target &&
+                copyTable.back().src + copyTable.back().bytes == src && copyTable.back().dst + copyTable.back().bytes == dst)
+            {
+                copyTable.back().bytes += bytes; //contiguous on both ends, just make the last copy bigger
+            }
+            else
+            {
+                copyTable.push_back({target,src,dst,bytes});
+            }
+            src += bytes;
+        }
+        aggregates[divisor] += numbers[i];
+    }
+    staging.resize(copyTargets.size());
+}
+
+void BasicRenderPipeline::initVerticies(const float* verts, int floatsPerVertex_ , int vertexAmount_)
+{
+    if (verts && floatsPerVertex_ > 0 && vertexAmount_ > 0)
+    {
+        GLState::bindVertexArray(VAO);
+        glGenBuffers(1,&verticies);
+        GLState::bindBuffer(GL_ARRAY_BUFFER,verticies);
+
+        glBufferData(GL_ARRAY_BUFFER, floatsPerVertex_*vertexAmount_*sizeof(float),verts, GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0,floatsPerVertex_,GL_FLOAT,GL_FALSE,0,0);
+    }
+}
+
+void BasicRenderPipeline::initAttribDivisors(Numbers numbers)
+{
+    int maxDivisor = 1;
+    for (size_t i = 1; i < numbers.size(); ++i)
+    {
+        maxDivisor = std::max(maxDivisor,getDivisor(i));
+    }
+    vbos.resize(maxDivisor + 1);
+    payload.resize(maxDivisor + 1);
+
+    int total = 0;
+    for (int i = 1; i < numbers.size(); ++i)
+    {
+        int divisor = getDivisor(i);
+        if (vbos[divisor].floatsPerVertex == 0)
+        {
+            glGenBuffers(1,&vbos[divisor].VBO);
+        }
+        vbos[divisor].floatsPerVertex += numbers[i];
+        total += numbers[i]*(divisor == 0 ? vertexAmount : 1); //if an attribute is per vertex, then it needs to be provided once per vertex
+    }
+    dataAmount = total*sizeof(GLfloat);
+    initCopyTable();
+
+    streaming = StreamBuffer::isSupported() && GLEW_ARB_base_instance;
+    for (size_t divisor = 2; divisor < vbos.size() && streaming; ++divisor)
+    {
+        //the GPU looks up divisor n data at baseInstance/n, but every divisor shares one cursor. Easier to not stream than to keep a cursor per divisor
+        streaming = vbos[divisor].floatsPerVertex == 0;
+    }
+    if (streaming)
+    {
+        initStreams(1024); //arbitrary starting size, grows as needed
+    }
+    else
+    {
+        initAttribPointers();
+    }
+}
+
+void BasicRenderPipeline::initAttribPointers()
+{
+    GLState::bindVertexArray(VAO);
+
+    int index = 1; //we start at 1 because RenderProgram uses index 0 to store verticies
+    std::vector<int> aggregates(vbos.size(),0); //how many floats we've put in for each divisor
+    while (index < numbers.size()) //we skip the first input, assuming it is the vertex. If your vertex shader's first input is not verticies, this function will not work
+    {
+        int num = numbers[index]; //number of floats for this vertex
+        for (int i = 0; i < num; i+= 4) //usually this only runs once, but if you have something that's larger than 4 floats (matricies) this will pass in every 4 floats in
+        {
+            int amount = std::min(num-i,4); //can't store larger than a vec4 at a time
+            int divisor = getDivisor(index - i/4);
+            GLState::bindBuffer(GL_ARRAY_BUFFER,vbos[divisor].VBO);
+            //std::cout << num << " " << divisor << "\n";
+            glVertexAttribPointer(index, amount, GL_FLOAT, GL_FALSE,(vbos[divisor].floatsPerVertex)*sizeof(float), (void*)(aggregates[divisor]*sizeof(float)));
+            glEnableVertexAttribArray(index);
+            glVertexAttribDivisor(index, divisor);
+
+            index ++;
+            aggregates[divisor] += amount;
+
+        }
+    }
+}
+
+void BasicRenderPipeline::packDataHelper(RenderPayload& payload, int divisorsIndex, int vertexIndex)
+{
+    if (divisorsIndex < numbers.size()) //for each divisor that we didn't fully fill up, fill with 0s
+    {
+        //std::cout << divisorsIndex << " " << numbers[divisorsIndex] << "\n";
+        std::vector<char>* bytes = &(payload[getDivisor(divisorsIndex)]);
+        bytes->insert(bytes->end(),numbers[divisorsIndex]*(vertexAmount - vertexIndex)*sizeof(float),0);
+        packDataHelper(payload,divisorsIndex+1,std::max(1,getDivisor(divisorsIndex+1)*vertexAmount-1) );
+
+    }
+}
+
+RenderCamera* ViewPort::currentCamera = nullptr;
+Buffer ViewPort::UBO = 0;
+UBOContents ViewPort::uniforms;
+int ViewPort::screenWidth = 0;
+int ViewPort::screenHeight = 0;
+ViewPort::PROJECTION_TYPE ViewPort::proj = ORTHOGRAPHIC;
+
+ViewRange ViewPort::baseRange;
+ViewRange ViewPort::currentRange;
+
+std::unique_ptr<RenderProgram> ViewPort::basicProgram;
+std::unique_ptr<RenderProgram> ViewPort::animeProgram;
+std::unique_ptr<RenderProgram> ViewPort::sprite9Program;
+std::unique_ptr<RenderProgram> ViewPort::spriteSheetProgram;
+std::unique_ptr<RenderProgram> ViewPort::atlasProgram;
+
+
+void ViewPort::init(int screenWidth, int screenHeight)
+{
+    ViewPort::screenWidth = screenWidth;
+    ViewPort::screenHeight = screenHeight;
+
+    glewExperimental = true;
+
+    GLenum err=glewInit();
+      if(err!=GLEW_OK) {
+        // Problem: glewInit failed, something is seriously wrong.
+        std::cout << "glewInit failed: " << glewGetErrorString(err) << std::endl;
+      }
+
+    baseRange =
+    {
+        {0,screenWidth},
+        {0,screenHeight},
+        {0.0f,100.0f}     //magic numbers. Can be anything for orthographic views but perspective views will clamp the x value to 0.1, as it must be positive
+    };
+    currentRange = baseRange;
+
+    GLState::invalidate(); //could be a brand new context
+glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
+    GLState::setBlend(true);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_PRIMITIVE_RESTART);
+
+    glDepthFunc(GL_LEQUAL);
+
+
+
+    //betterShader, plus a draw id so sprites with different textures can be drawn together
+    std::string basicVertex = templateShader(stripComments(readFile(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/betterShader.h").first), true,
+                                        {"float drawID"},
+                                        {"int spriteSlot"},
+                                        {"spriteSlot = int(drawID)"});
+    basicProgram = std::unique_ptr<RenderProgram>(new RenderProgram({LoadShaderInfo{basicVertex,GL_VERTEX_SHADER,false},
+                                                                    LoadShaderInfo{ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/spritesFragment.h",GL_FRAGMENT_SHADER,true}}));
+    basicProgram->setDrawIDs(true);
+    basicProgram->setOpaqueSafe(true);
+    animeProgram = std::make_unique<RenderProgram>(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/animationShader.h",
+                      ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/fragmentShader.h");
+    animeProgram->setOpaqueSafe(true);
+    spriteSheetProgram = std::make_unique<RenderProgram>(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/spriteSheetVertex.h",
+                      ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/fragmentShader.h");
+
+    //same as basicProgram, but the texture coordinates are moved to wherever the sprite is in the atlas
+    std::string atlasVertex = templateShader(stripComments(readFile(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/betterShader.h").first), true,
+                                        {"vec4 atlasRect","float atlasLayer"},
+                                        {"float layer"},
+                                        {"texCoord = atlasRect.xy + texCoord*atlasRect.zw","layer = atlasLayer"});
+    atlasProgram = std::unique_ptr<RenderProgram>(new RenderProgram({LoadShaderInfo{atlasVertex,GL_VERTEX_SHADER,false},
+                                                                    LoadShaderInfo{ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/atlasFragment.h",GL_FRAGMENT_SHADER,true}}));
+    atlasProgram->setAtlased(true);
+    atlasProgram->setOpaqueSafe(true);
+    sprite9Program = std::make_unique<RenderProgram>(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/sprite9Vertex.h",
+                      ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/tintFragment.h",DivisorStorage{0},Sprite9::getVerticies(),4,54);
+    sprite9Program->setOpaqueSafe(false); //the tint can make opaque panels transluscent, so panels always go with the transluscents
+
+    GPUProfiler::setName(basicProgram->getID(),"basicProgram");
+    GPUProfiler::setName(sprite9Program->getID(),"sprite9Program");
+    GPUProfiler::setName(animeProgram->getID(),"animeProgram");
+    GPUProfiler::setName(spriteSheetProgram->getID(),"spriteSheetProgram");
+    GPUProfiler::setName(atlasProgram->getID(),"atlasProgram");
+
+    resetUniforms();
+
+    glGenBuffers(1,&UBO);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER,UBO);
+    glBufferData(GL_UNIFORM_BUFFER,sizeof(UBOContents),nullptr, GL_STATIC_DRAW); // allocate enough memory for our UBO
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, UBO);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+
+
+}
+
+
+glm::vec4 RenderCamera::toScreen(const glm::vec4& change) const
+{
+        //REFACTOR: Finish this for perspective mode
+
+    glm::vec2 point = toScreen({change.x,change.y});
+    return {point.x,point.y,change.z, change.a};
+}
+
+glm::vec2 RenderCamera::toScreen(const glm::vec2& point) const
+{
+    //REFACTOR: Finish this for perspective mode
+
+    return (point - getTopLeft())/glm::vec2(ViewPort::getViewWidth(),ViewPort::getViewHeight())*ViewPort::getScreenDimen();
+}
+
+glm::vec4 RenderCamera::toWorld(const glm::vec4& change, ZType z) const
+{
+    //REFACTOR: Finish this for perspective mode
+
+    glm::vec2 point = toWorld({change.x,change.y});
+    return {point.x,point.y , change.z, change.a};
+}
+
+glm::vec2 RenderCamera::toWorld(const glm::vec2& point,ZType z) const
+{    //REFACTOR: Finish this for perspective mode
+    glm::vec2 screenDimen = ViewPort::getScreenDimen();
+
+    if (ViewPort::getProj() == ViewPort::PERSPECTIVE)
+    {
+        float screenHeight = 2*( getPos().z - z)*(tan(glm::radians(ViewPort::FOV/2)));
+        float screenWidth = screenHeight/screenDimen.y*screenDimen.x;
+        return glm::vec2(getPos()) + glm::vec2((point.x - screenDimen.x/2)/screenDimen.x*screenWidth, ((point.y - screenDimen.y/2)/screenDimen.y*screenHeight));
+    }
+
+
+    return getTopLeft()+ glm::vec2((point.x)/screenDimen.x*ViewPort::getViewWidth(), ((point.y)/screenDimen.x*ViewPort::getViewHeight()));
+}
+
+glm::vec4 RenderCamera::toAbsolute(const glm::vec4& rect) const
+{
+    if (ViewPort::getProj() == ViewPort::PERSPECTIVE)
+    {
+        //returns toAbsolute if rect is rendered as close to the camera as possible
+        glm::vec2 screenDimen = ViewPort::getScreenDimen();
+
+        float screenHeight = (ViewPort::getZRange().x + 1)*2*(tan(glm::radians(ViewPort::FOV/2)));
+        float screenWidth = screenHeight/screenDimen.y*screenDimen.x;
+
+        return glm::vec4(-screenWidth + pos.x + (rect.x)/screenDimen.x*screenWidth,
+                -screenHeight + pos.y + (rect.y)/screenDimen.y*screenHeight,
+                rect.z/screenDimen.x*screenWidth,
+                rect.a/screenDimen.y*screenHeight);
+    }
+    return glm::vec4(getTopLeft() + glm::vec2(rect.x,rect.y),rect.z,rect.a);
+}
+glm::vec2 RenderCamera::toAbsolute(const glm::vec2& point) const
+{
+    glm::vec4 rect = toAbsolute(glm::vec4(point,0,0));
+    return {rect.x,rect.y};
+}
+glm::vec2 ViewPort::toAbsolute(const glm::vec2& point)
+{
+    return currentCamera ? currentCamera->toAbsolute(point) : point;
+}
+glm::vec4 ViewPort::toAbsolute(const glm::vec4& rect)
+{
+    return currentCamera ? currentCamera->toAbsolute(rect) : rect;
+}
+
+bool ViewPort::culling = false;
+
+glm::vec4 ViewPort::getWorldRect(float z)
+{
+    if (proj == PERSPECTIVE)
+    {
+        //same math as RenderCamera::toWorld, the view is centered on the camera
+        glm::vec3 eye = currentCamera ? currentCamera->getPos() : glm::vec3(0,0,currentRange.zRange.y);
+        float height = std::max(0.0f,2*(eye.z - z)*tan(glm::radians(FOV/2))); //nothing is visible behind the camera
+        float width = height/screenHeight*screenWidth;
+        return glm::vec4(eye.x - width/2, eye.y - height/2, width, height);
+    }
+    //see getViewMatrix, the camera's position is in the middle of the screen rather than the top left
+    glm::vec2 topLeft = currentCamera ? glm::vec2(currentCamera->getPos()) - 0.5f*glm::vec2(getViewWidth(),getViewHeight()) : glm::vec2(0);
+    return glm::vec4(topLeft.x + currentRange.xRange.x,topLeft.y + currentRange.yRange.x,getViewWidth(),getViewHeight());
+}
+
+bool ViewPort::isVisible(const glm::vec4& rect, float z)
+{
+    glm::vec4 view = getWorldRect(z);
+    if (view.z <= 0 || view.a <= 0)
+    {
+        return false;
+    }
+    //rects can have negative dimensions if they are flipped
+    float left = std::min(rect.x,rect.x + rect.z), right = std::max(rect.x,rect.x + rect.z);
+    float top = std::min(rect.y,rect.y + rect.a), bottom = std::max(rect.y,rect.y + rect.a);
+    return left <= view.x + view.z && right >= view.x && top <= view.y + view.a && bottom >= view.y;
+}
+
+bool ViewPort::isVisible(const glm::vec4& rect, float z, float angle)
+{
+    if (angle == 0)
+    {
+        return isVisible(rect,z);
+    }
+    //bounding box of the rotated rect
+    float c = fabs(cos(angle)), s = fabs(sin(angle));
+    glm::vec2 halfDimen = glm::vec2(fabs(rect.z)*c + fabs(rect.a)*s,fabs(rect.z)*s + fabs(rect.a)*c)*0.5f;
+    glm::vec2 center = glm::vec2(rect.x + rect.z/2, rect.y + rect.a/2);
+    return isVisible(glm::vec4(center - halfDimen,halfDimen*2.0f),z);
+}
+
+bool ViewPort::isVisible(const glm::vec2& center, float radius, float z)
+{
+    return isVisible(glm::vec4(center.x - radius,center.y - radius,radius*2,radius*2),z);
+}
+
+glm::vec2 ViewPort::toWorld(const glm::vec2& point, ZType z)
+{
+    return currentCamera ? currentCamera->toWorld(point,z) : point;
+}
+
+glm::vec4 ViewPort::toWorld(const glm::vec4& rect, ZType z)
+{
+    return glm::vec4(toWorld({rect.x,rect.y},z),rect.z,rect.a);
+}
+
+glm::vec2 ViewPort::toScreen(const glm::vec2& point)
+{
+    return currentCamera ? currentCamera->toScreen(point) : point;
+}
+
+glm::vec4 ViewPort::toScreen(const glm::vec4& rect)
+{
+    return glm::vec4(toScreen({rect.x,rect.y}),rect.z,rect.a);
+}
+
+const glm::vec2& ViewPort::getXRange()
+{
+    return currentRange.xRange;
+}
+const glm::vec2& ViewPort::getYRange()
+{
+    return currentRange.yRange;
+}
+const glm::vec2& ViewPort::getZRange()
+{
+    return currentRange.zRange;
+}
+
+const float ViewPort::getViewWidth()
+{
+    return currentRange.xRange.y - currentRange.xRange.x;
+}
+
+const float ViewPort::getViewHeight()
+{
+    return currentRange.yRange.y - currentRange.yRange.x;
+}
+
+const float ViewPort::getViewDepth()
+{
+    return currentRange.zRange.y - currentRange.zRange.x;
+}
+
+void ViewPort::setXRange(float x1, float x2)
+{
+    setViewRange({
+                 {x1,x2},
+                 currentRange.yRange,
+                 currentRange.zRange
+                 });
+}
+void ViewPort::setYRange(float y1, float y2)
+{
+    setViewRange({
+                 currentRange.xRange,
+                 {y1,y2},
+                 currentRange.zRange
+                 });
+}
+void ViewPort::setZRange(float z1, float z2)
+{
+    setViewRange({
+                 currentRange.xRange,
+                 currentRange.yRange,
+                 {z1,z2}
+                 });
+}
+
+void ViewPort::resetViewRange()
+{
+    setViewRange(baseRange);
+}
+
+glm::mat4 ViewPort::getProjMatrix()
+{
+    if (proj) //return PROJECTION view
+    {
+        return glm::scale(glm::perspective(glm::radians(FOV), (float)screenWidth/(float)screenHeight, std::max(0.1f,currentRange.zRange.x), currentRange.zRange.y),
+                      glm::vec3(1,-1,1)); //flip y because otherwise sprites will be upside down
+    } //otherwise return orthographic view
+    return (glm::ortho(currentRange.xRange.x, currentRange.xRange.y, currentRange.yRange.y, currentRange.yRange.x, currentRange.zRange.x, currentRange.zRange.y));
+}
+
+glm::mat4 ViewPort::getViewMatrix()
+{
+    if (currentCamera) //REFACTOR: might be faster to not have to recalculate this every frame
+    {
+        glm::vec3 pos = currentCamera->getPos() - static_cast<float>(proj == ORTHOGRAPHIC)*0.5f*glm::vec3(ViewPort::getViewWidth(),ViewPort::getViewHeight(),0); //for some reason, looking at point(x,y) in ortho view causes point(x,y) to be on the top left corner of the screen
+                                                                                                                 //not sure why, but that's a problem for future leo, this here is a work around
+        return glm::lookAt(pos,glm::vec3(glm::vec2(pos),currentRange.zRange.x),glm::vec3(0,1,0));
+    }
+    else
+    {
+        //glm::vec2 pos = {screenWidth/2,screenHeight/2};
+        return glm::lookAt(glm::vec3(0,0,currentRange.zRange.y),
+                           glm::vec3(0,0,0),
+                           glm::vec3(0,1,0)); //if no camera, put view matrix at farthest possible Z and put {0,0} at the top left corner
+        //glm::lookAt(glm::vec3(pos,currentRange.zRange.y),glm::vec3(pos,currentRange.zRange.x),glm::vec3(0,1,0));
+    }
+}
+
+ViewPort::PROJECTION_TYPE ViewPort::getProj()
+{
+    return proj;
+}
+
+void ViewPort::flipProj()
+{
+    proj = static_cast<PROJECTION_TYPE>(!(static_cast<bool>(proj)));
+
+    uniforms.perspectiveMatrix = getProjMatrix();
+}
+
+glm::vec2 ViewPort::getScreenDimen()
+{
+    return {screenWidth,screenHeight};
+}
+
+void ViewPort::linkUniformBuffer(unsigned int program)
+{
+    unsigned int index =glGetUniformBlockIndex(program,"Matrices");
+    //std::cout << glGetError() << "\n";
+    if (index != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(program, index, 0);
+    }
+
+}
+
+void ViewPort::update()
+{
+    GLState::bindBuffer(GL_UNIFORM_BUFFER,UBO);
+
+    uniforms.cameraZ = currentCamera ? currentCamera->getPos().z : 1;
+    uniforms.viewMatrix = getViewMatrix();
+    uniforms.time = SDL_GetTicks();
+
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(UBOContents), &uniforms);
+    RenderCounters::bytesUploaded += sizeof(UBOContents);
+    //UBO stays attached to binding point 0 from resetUniforms, and stays bound so next frame's bind is skipped
+}
+
+void ViewPort::setViewRange(const ViewRange& range)
+{
+    currentRange = range;
+    uniforms.perspectiveMatrix = getProjMatrix();
+}
+
+void ViewPort::resetUniforms()
+{
+    GLState::bindBuffer(GL_UNIFORM_BUFFER,UBO);
+
+    //reset all values in uniforms
+    uniforms.cameraZ = currentCamera ? currentCamera->getPos().z : ViewPort::getViewDepth();
+    uniforms.perspectiveMatrix = getProjMatrix();
+    uniforms.viewMatrix = getViewMatrix();
+    uniforms.screenDimen = glm::vec2(screenWidth,screenHeight);
+    uniforms.time = SDL_GetTicks();
+
+    //pass the uniforms
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(UBOContents), &uniforms, GL_STATIC_DRAW); // allocate enough memory for two 4x4 matricies and the camera position. Remember that a glm::vec4 is 16 bytes, so each matrix is 64 bytes
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, UBO);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+/*void RenderProgram::drawInstanced(Buffer sprite, void* data, int instances)
+{
+    glBindVertexArray(VAO);
+    glBindTexture(GL_TEXTURE_2D,sprite);
+
+    if (data)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER,VBO);
+        glBufferData(GL_ARRAY_BUFFER,dataAmount*instances,data,GL_DYNAMIC_DRAW);
+    }
+
+    use();
+
+    glDrawArraysInstanced(GL_TRIANGLES,0,6,instances);
+
+    //glDrawElementsInstanced(GL_TRIANGLES,6,GL_UNSIGNED_INT,indices,instances);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+}*/
+
+RenderCamera::~RenderCamera()
+{
+    if (ViewPort::currentCamera == this)
+    {
+        ViewPort::currentCamera = 0;
+    }
+}
+
+void RenderCamera::init(const glm::vec3& pos_)
 {
-    setViewRange({
-                 currentRange.xRange,
-                 currentRange.yRange,
-                 {z1,z2}
-                 });
+    setPos(pos_);
+}
+
+const glm::vec3& RenderCamera::getPos() const
+{
+    return pos;
+}
+
+glm::vec2 RenderCamera::getTopLeft() const
+{
+    glm::vec2 dimen = ViewPort::getScreenDimen();
+
+    return {pos.x - dimen.x/2, pos.y - dimen.y/2};
+}
+
+glm::vec4 RenderCamera::getRect() const
+{
+    glm::vec2 dimen = ViewPort::getScreenDimen();
+    return glm::vec4(getTopLeft(), dimen.x,dimen.y);
+}
+
+void RenderCamera::setPos(const glm::vec3& pos_)
+{
+    pos = pos_;
+}
+
+void RenderCamera::setPos(const glm::vec2& pos_)
+{
+    pos = glm::vec3(pos_,pos.z);
+}
+
+void RenderCamera::addVector(const glm::vec2& vec)
+{
+    setPos(glm::vec3(pos.x + vec.x, pos.y + vec.y, pos.z));
+}
+
+void RenderCamera::addVector(const glm::vec3& vec)
+{
+    setPos(pos + vec);
+}
+
+//finds the first and last pixel in "row" that isn't fully transparent (-1 if there are none), and whether the row has any partially or fully transparent pixels.
+//Every 4 (SSE2) or 8 (AVX2) pixels are checked at once, the rest one at a time
+static void classifyRow(const unsigned char* row, int width, int& first, int& last, bool& partial, bool& transparent)
+{
+    first = -1;
+    last = -1;
+    int x = 0;
+    auto addVisible = [&first,&last](int x, unsigned int visible){ //"visible" has a bit for each pixel starting at "x" that isn't fully transparent
+        if (visible)
+        {
+            if (first == -1)
+            {
+                first = x + __builtin_ctz(visible);
+            }
+            last = x + 31 - __builtin_clz(visible);
+        }
+    };
+#if defined(__AVX2__)
+    const __m256i alphaMask = _mm256_set1_epi32(0xFF000000); //pixels are RGBA bytes, so alpha is the top byte of each little endian int
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i alpha = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x*4)),alphaMask);
+        unsigned int zero = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(alpha,_mm256_setzero_si256())));
+        unsigned int full = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(alpha,alphaMask)));
+        partial |= (zero | full) != 0xFF;
+        transparent |= zero != 0;
+        addVisible(x,~zero & 0xFF);
+    }
+#elif defined(__SSE2__)
+    const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i alpha = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x*4)),alphaMask);
+        unsigned int zero = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(alpha,_mm_setzero_si128())));
+        unsigned int full = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(alpha,alphaMask)));
+        partial |= (zero | full) != 0xF;
+        transparent |= zero != 0;
+        addVisible(x,~zero & 0xF);
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        unsigned char alpha = row[x*4 + 3];
+        partial |= alpha != 0 && alpha != 255;
+        transparent |= alpha == 0;
+        addVisible(x,alpha != 0);
+    }
+}
+
+AlphaInfo classifyAlpha(const unsigned char* rgba, int width, int height)
+{
+    //note: images with only 0 and 255 alpha still get partially transparent pixels along their edges once they are linearly filtered.
+    //Cutouts are drawn by discarding anything below 0.5 alpha, so their edges are a little jagged compared to blending them
+    bool partial = false, transparent = false;
+    int left = width, right = -1, top = -1, bottom = -1;
+    for (int y = 0; y < height; ++y)
+    {
+        int first = -1, last = -1;
+        classifyRow(rgba + (size_t)y*width*4,width,first,last,partial,transparent);
+        if (first != -1)
+        {
+            left = std::min(left,first);
+            right = std::max(right,last);
+            top = top == -1 ? y : top;
+            bottom = y;
+        }
+    }
+    AlphaInfo info;
+    info.type = partial ? ALPHA_TRANSLUSCENT : (transparent ? ALPHA_CUTOUT : ALPHA_OPAQUE);
+    if (top != -1)
+    {
+        info.bounds = glm::ivec4(left,top,right - left + 1,bottom - top + 1);
+    }
+    return info;
+}
+
+bool isTransluscent(unsigned char* sprite, int width, int height)
+{
+    return classifyAlpha(sprite,width,height).type != ALPHA_OPAQUE;
+}
+
+
+bool TextureCache::isEnabled()
+{
+    return ResourcesConfig::config.find(ResourcesConfig::TEXTURE_CACHE_DIR) != ResourcesConfig::config.end();
+}
+
+std::string TextureCache::getPath(const std::string& source, int desiredChannels)
+{
+    std::error_code error;
+    std::string absolute = std::filesystem::absolute(source,error).string(); //so "./a.png" and "a.png" are the same file
+    uint64_t key = hashBytes(absolute.c_str(),absolute.size());
+    key = hashBytes(reinterpret_cast<const char*>(&desiredChannels),sizeof(desiredChannels),key);
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx.tex",(unsigned long long)key);
+    return ResourcesConfig::config[ResourcesConfig::TEXTURE_CACHE_DIR] + "/" + name;
+}
+
+bool TextureCache::getSourceInfo(const std::string& source, uint64_t& size, int64_t& time)
+{
+    std::error_code error;
+    size = std::filesystem::file_size(source,error);
+    if (error)
+    {
+        return false;
+    }
+    time = std::filesystem::last_write_time(source,error).time_since_epoch().count();
+    return !error;
+}
+
+bool TextureCache::load(const std::string& source, int desiredChannels, Image& image)
+{
+    uint64_t size = 0;
+    int64_t time = 0;
+    if (!isEnabled() || !getSourceInfo(source,size,time) || !image.file.open(getPath(source,desiredChannels)))
+    {
+        return false;
+    }
+    const unsigned char* data = image.file.getData();
+    size_t fileSize = image.file.getSize();
+    if (fileSize < sizeof(Header))
+    {
+        image.file.close();
+        return false;
+    }
+    Header header;
+    memcpy(&header,data,sizeof(Header));
+    if (memcmp(header.magic,"TEXC",4) != 0 || header.version != VERSION || header.sourceSize != size || header.sourceTime != time ||
+        header.channels < 1 || header.channels > 4 || header.levels < 1 || header.levels > 32 || header.alphaClass > ALPHA_TRANSLUSCENT)
+    {
+        image.file.close();
+        return false;
+    }
+    image.levels.clear();
+    size_t offset = sizeof(Header);
+    for (uint32_t i = 0; i < header.levels; ++i)
+    {
+        size_t levelSize = (size_t)std::max(1u,header.width >> i)*std::max(1u,header.height >> i)*header.channels;
+        if (offset + levelSize > fileSize) //truncated
+        {
+            image.levels.clear();
+            image.file.close();
+            return false;
+        }
+        image.levels.push_back(data + offset);
+        offset += levelSize;
+    }
+    image.width = header.width;
+    image.height = header.height;
+    image.channels = header.channels;
+    image.alpha.type = static_cast<AlphaClass>(header.alphaClass);
+    image.alpha.bounds = glm::ivec4(header.bounds[0],header.bounds[1],header.bounds[2],header.bounds[3]);
+    return true;
+}
+
+std::vector<unsigned char> TextureCache::halve(const unsigned char* pixels, int width, int height, int channels)
+{
+    //each pixel is the average of the 2x2 block above it. Odd sizes just repeat the last row or column
+    int halfW = std::max(1,width/2);
+    int halfH = std::max(1,height/2);
+    std::vector<unsigned char> half(halfW*halfH*channels);
+    for (int y = 0; y < halfH; ++y)
+    {
+        int y1 = std::min(2*y,height - 1), y2 = std::min(2*y + 1,height - 1);
+        for (int x = 0; x < halfW; ++x)
+        {
+            int x1 = std::min(2*x,width - 1), x2 = std::min(2*x + 1,width - 1);
+            for (int c = 0; c < channels; ++c)
+            {
+                int sum = pixels[(y1*width + x1)*channels + c] + pixels[(y1*width + x2)*channels + c] +
+                          pixels[(y2*width + x1)*channels + c] + pixels[(y2*width + x2)*channels + c];
+                half[(y*halfW + x)*channels + c] = (sum + 2)/4;
+            }
+        }
+    }
+    return half;
+}
+
+void TextureCache::save(const std::string& source, int desiredChannels, const unsigned char* pixels, int width, int height, int channels, const AlphaInfo& alpha)
+{
+    Header header;
+    memcpy(header.magic,"TEXC",4);
+    header.version = VERSION;
+    if (!isEnabled() || !getSourceInfo(source,header.sourceSize,header.sourceTime))
+    {
+        return;
+    }
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.levels = log2(std::max(width,height)) + 1; //all the way down to 1x1, same as glGenerateMipmap
+    header.alphaClass = alpha.type;
+    for (int i = 0; i < 4; ++i)
+    {
+        header.bounds[i] = alpha.bounds[i];
+    }
+    header.padding = 0;
+
+    std::error_code error;
+    std::filesystem::create_directories(ResourcesConfig::config[ResourcesConfig::TEXTURE_CACHE_DIR],error);
+    std::string path = getPath(source,desiredChannels);
+    //write somewhere else first so nobody maps a half written file. Worker threads can be saving at the same time, so the name has to be unique
+    std::stringstream temp;
+    temp << path << "." << std::this_thread::get_id() << ".tmp";
+    std::ofstream file(temp.str(),std::ios::binary);
+    if (!file.is_open())
+    {
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+    file.write(reinterpret_cast<const char*>(pixels),width*height*channels);
+    std::vector<unsigned char> level;
+    for (uint32_t i = 1; i < header.levels; ++i)
+    {
+        level = halve(i == 1 ? pixels : level.data(),std::max(1,width >> (i - 1)),std::max(1,height >> (i - 1)),channels);
+        file.write(reinterpret_cast<const char*>(level.data()),level.size());
+    }
+    file.close();
+    if (!file)
+    {
+        std::filesystem::remove(temp.str(),error);
+        return;
+    }
+    std::filesystem::rename(temp.str(),path,error);
+    if (error) //on windows, rename fails if someone has the old file mapped
+    {
+        std::filesystem::remove(temp.str(),error);
+    }
+}
+
+bool TextureCache::bake(const std::string& source, bool atlased)
+{
+    int width = 0, height = 0, channels = 0;
+    unsigned char* data = stbi_load(source.c_str(),&width,&height,&channels,atlased ? 4 : 0);
+    if (!data)
+    {
+        return false;
+    }
+    channels = atlased ? 4 : channels;
+    save(source,atlased ? 4 : 0,data,width,height,channels,channels == 4 ? classifyAlpha(data,width,height) : AlphaInfo{ALPHA_OPAQUE,{0,0,width,height}});
+    stbi_image_free(data);
+    return true;
+}
+
+SpriteAtlas SpriteAtlas::atlas;
+
+void SpriteAtlas::init(int pageSize_, int layers_)
+{
+    pageSize = pageSize_;
+    layers = layers_;
+    shelves.clear();
+    layerHeights.assign(layers,0);
+    placeholderLayer = -1;
+
+    glGenTextures(1,&texture);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY,texture);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    //every mipmap level halves our padding, so past log2(PADDING) levels neighbors start bleeding in. Up to then reserve keeps every slot aligned to PADDING,
+    //so no mipmap texel mixes two sprites
+    int maxLevel = log2(PADDING);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, maxLevel);
+    for (int i = 0; i <= maxLevel; ++i)
+    {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY,i,GL_RGBA8,std::max(1,pageSize >> i),std::max(1,pageSize >> i),layers,0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+    }
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY,0);
+}
+
+bool SpriteAtlas::add(unsigned char* data, int w, int h, int& layer, glm::vec4& rect)
+{
+    glm::ivec2 corner;
+    if (!reserve(w,h,layer,rect,corner))
+    {
+        return false;
+    }
+    std::vector<unsigned char> padded = pad(data,w,h);
+    upload(&padded[0],layer,corner,w + 2*PADDING,h + 2*PADDING);
+    return true;
+}
+
+bool SpriteAtlas::reserve(int w, int h, int& layer, glm::vec4& rect, glm::ivec2& corner)
+{
+    if (!texture)
+    {
+        init();
+    }
+    //slots are rounded up to a multiple of PADDING so every corner (and shelf) starts on a multiple of PADDING. Then every mipmap level we keep
+    //averages our texels only with our own padding, never a neighbor's. The extra pixels on the right and bottom are never sampled
+    int paddedW = (w + 2*PADDING + PADDING - 1)/PADDING*PADDING;
+    int paddedH = (h + 2*PADDING + PADDING - 1)/PADDING*PADDING;
+    if (paddedW > pageSize || paddedH > pageSize)
+    {
+        return false;
+    }
+
+    //find the shelf that wastes the least height
+    Shelf* best = nullptr;
+    for (auto it = shelves.begin(); it != shelves.end(); ++it)
+    {
+        if (it->height >= paddedH && pageSize - it->x >= paddedW && (!best || it->height < best->height))
+        {
+            best = &(*it);
+        }
+    }
+    if (!best) //no shelf fits, start a new one in the first layer with room
+    {
+        for (int i = 0; i < layers; ++i)
+        {
+            if (pageSize - layerHeights[i] >= paddedH)
+            {
+                shelves.push_back({i,layerHeights[i],paddedH,0});
+                layerHeights[i] += paddedH;
+                best = &shelves.back();
+                break;
+            }
+        }
+    }
+    if (!best)
+    {
+        return false;
+    }
+
+    layer = best->layer;
+    corner = {best->x,best->y};
+    rect = glm::vec4(best->x + PADDING,best->y + PADDING,w,h)/static_cast<float>(pageSize);
+    best->x += paddedW;
+    return true;
+}
+
+void SpriteAtlas::upload(const void* padded, int layer, const glm::ivec2& corner, int w, int h)
+{
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY,texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY,0,corner.x,corner.y,layer,w,h,1,GL_RGBA,GL_UNSIGNED_BYTE,padded);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY,0);
+    dirty = true;
+}
+
+std::vector<unsigned char> SpriteAtlas::pad(const unsigned char* data, int w, int h)
+{
+    //copy into a padded buffer, clamping to the edge pixels
+    int paddedW = w + 2*PADDING;
+    int paddedH = h + 2*PADDING;
+    std::vector<unsigned char> padded(paddedW*paddedH*4);
+    for (int y = 0; y < paddedH; ++y)
+    {
+        int srcY = std::min(std::max(y - PADDING,0),h - 1);
+        for (int x = 0; x < paddedW; ++x)
+        {
+            int srcX = std::min(std::max(x - PADDING,0),w - 1);
+            memcpy(&padded[(y*paddedW + x)*4],&data[(srcY*w + srcX)*4],4);
+        }
+    }
+    return padded;
+}
+
+void SpriteAtlas::getPlaceholder(int& layer, glm::vec4& rect)
+{
+    if (placeholderLayer == -1)
+    {
+        unsigned char grey[4] = {128,128,128,255};
+        if (!add(grey,1,1,placeholderLayer,placeholderRect))
+        {
+            placeholderLayer = 0; //atlas is full, so just point at whatever is in the corner
+            placeholderRect = {0,0,0,0};
+        }
+    }
+    layer = placeholderLayer;
+    rect = placeholderRect;
+}
+
+void SpriteAtlas::update()
+{
+    if (dirty)
+    {
+        GLState::bindTexture(GL_TEXTURE_2D_ARRAY,texture);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        GLState::bindTexture(GL_TEXTURE_2D_ARRAY,0);
+        dirty = false;
+    }
+}
+
+unsigned int SpriteAtlas::getTexture() const
+{
+    return texture;
 }
 
-void ViewPort::resetViewRange()
-{
-    setViewRange(baseRange);
-}
+   void Sprite::load(std::string source, bool atlased)
+    {
+        if (GLContext::isContextValid())
+        {
+            SpriteLoader::cancel(*this); //in case we were loading in the background
+            state = LOADED;
+            texture = 0;
+            layer = -1;
+            atlasRect = {0,0,1,1};
+            int channels = 0;
+            TextureCache::Image cached; //if we hit the cache, "data" points into this
+            bool hit = TextureCache::load(source,atlased ? 4 : 0,cached); //the atlas is always RGBA
+            unsigned char* data = nullptr;
+            if (hit)
+            {
+                width = cached.width;
+                height = cached.height;
+                channels = cached.channels;
+                alpha = cached.alpha;
+                data = const_cast<unsigned char*>(cached.levels[0]);
+            }
+            else
+            {
+                //auto imageData = cv::imread(source);
+                data = stbi_load(source.c_str(),&width, &height, &channels, atlased ? 4 : 0);
+                if (data)
+                {
+                    channels = atlased ? 4 : channels; //stbi_load gives us the channels in the file, not the ones we asked for
+                    alpha = channels == 4 ? classifyAlpha(data,width,height) : AlphaInfo{ALPHA_OPAQUE,{0,0,width,height}};
+                    if (TextureCache::isEnabled())
+                    {
+                        TextureCache::save(source,atlased ? 4 : 0,data,width,height,channels,alpha);
+                    }
+                }
+            }
+            if (atlased && data)
+            {
+                if (SpriteAtlas::atlas.add(data,width,height,layer,atlasRect))
+                {
+                    if (!hit)
+                    {
+                        stbi_image_free(data);
+                    }
+                    return;
+                }
+                std::cout << "Atlas is full, giving sprite its own texture: " << source << std::endl;
+            }
+
+            glGenTextures(1, &texture);
+            GLState::bindTexture(GL_TEXTURE_2D,texture);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            int rgb = 0;// GL_RGB*!transparent + GL_RGBA*transparent;
+            switch (channels)
+            {
+            case 1:
+                rgb = GL_RED;
+                break;
+            case 2:
+                rgb = GL_RG;
+                break;
+            case 3:
+                rgb = GL_RGB;
+                break;
+            case 4:
+                rgb = GL_RGBA;
+                break;
+            }
+
+            if (hit)
+            {
+                //the cache already has every mipmap level
+                glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+                for (size_t i = 0; i < cached.levels.size(); ++i)
+                {
+                    glTexImage2D(GL_TEXTURE_2D, i, rgb,std::max(1,width >> i), std::max(1,height >> i), 0, rgb, GL_UNSIGNED_BYTE, cached.levels[i]);
+                }
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, cached.levels.size() - 1);
+                glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+            }
+            else if (data)
+            {
+                glTexImage2D(GL_TEXTURE_2D, 0, rgb,width, height, 0, rgb, GL_UNSIGNED_BYTE, data);
+                glGenerateMipmap(GL_TEXTURE_2D);
+                stbi_image_free(data);
+            }
+            else
+            {
+                std::cout << "Error loading texture: " << source << std::endl;
+                state = FAILED;
+            }
+        }
+        else
+        {
+            throw std::runtime_error("WOAW MISS\n\nPUMP THE BRAKES\n\nARE YOU TRYING TO INITIALIZE A SPRITE WITHOUT AN OPENGL CONTEXT???\n\nI'm going to have to respectfully decline\n\nYou can\'t initialize textures before initializing an OpenGL Context(https://www.khronos.org/opengl/wiki/Common_Mistakes#The_Object_Oriented_Language_Problem)");
+        }
+
+    }
 
-glm::mat4 ViewPort::getProjMatrix()
-{
-    if (proj) //return PROJECTION view
+Sprite::Sprite( std::string source, bool atlased)
     {
-        return glm::scale(glm::perspective(glm::radians(FOV), (float)screenWidth/(float)screenHeight, std::max(0.1f,currentRange.zRange.x), currentRange.zRange.y),
-                      glm::vec3(1,-1,1)); //flip y because otherwise sprites will be upside down
-    } //otherwise return orthographic view
-    return (glm::ortho(currentRange.xRange.x, currentRange.xRange.y, currentRange.yRange.y, currentRange.yRange.x, currentRange.zRange.x, currentRange.zRange.y));
+        init(source,atlased);
+    }
+void Sprite::loadAsync(std::string source_, bool atlased)
+{
+    source = source_;
+    SpriteLoader::load(*this,source_,atlased);
 }
 
-glm::mat4 ViewPort::getViewMatrix()
-{
-    if (currentCamera) //REFACTOR: might be faster to not have to recalculate this every frame
+    Sprite::~Sprite()
     {
-        glm::vec3 pos = currentCamera->getPos() - static_cast<float>(proj == ORTHOGRAPHIC)*0.5f*glm::vec3(ViewPort::getViewWidth(),ViewPort::getViewHeight(),0); //for some reason, looking at point(x,y) in ortho view causes point(x,y) to be on the top left corner of the screen
-                                                                                                                 //not sure why, but that's a problem for future leo, this here is a work around
-        return glm::lookAt(pos,glm::vec3(glm::vec2(pos),currentRange.zRange.x),glm::vec3(0,1,0));
+        if (state == LOADING)
+        {
+            SpriteLoader::cancel(*this);
+        }
+        /*if there is no opengl context glDeleteTextures crashes. "context" = false means that our main function has ended, in which case there is no longer
+        a guarnatee to be an openGL context (and the OS will free our memory anyway) so don't delete the texture*/
+        //if (GLContext::isContextValid())
+        //glDeleteTextures(1,&texture);
     }
-    else
+
+void Sprite::init(std::string source_, bool atlased)
     {
-        //glm::vec2 pos = {screenWidth/2,screenHeight/2};
-        return glm::lookAt(glm::vec3(0,0,currentRange.zRange.y),
-                           glm::vec3(0,0,0),
-                           glm::vec3(0,1,0)); //if no camera, put view matrix at farthest possible Z and put {0,0} at the top left corner
-        //glm::lookAt(glm::vec3(pos,currentRange.zRange.y),glm::vec3(pos,currentRange.zRange.x),glm::vec3(0,1,0));
+        load(source_,atlased);
+        source = source_;
     }
+unsigned int Sprite::getTexture() const
+{
+    return isAtlased() ? SpriteAtlas::atlas.getTexture() : texture;
 }
-
-ViewPort::PROJECTION_TYPE ViewPort::getProj()
+GLenum Sprite::getTarget() const
 {
-    return proj;
+    return isAtlased() ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
 }
-
-void ViewPort::flipProj()
+int Sprite::getLayer() const
 {
-    proj = static_cast<PROJECTION_TYPE>(!(static_cast<bool>(proj)));
-
-    uniforms.perspectiveMatrix = getProjMatrix();
+    return layer;
 }
-
-glm::vec2 ViewPort::getScreenDimen()
+const glm::vec4& Sprite::getAtlasRect() const
 {
-    return {screenWidth,screenHeight};
+    return atlasRect;
 }
-
-void ViewPort::linkUniformBuffer(unsigned int program)
+bool Sprite::isAtlased() const
 {
-    unsigned int index =glGetUniformBlockIndex(program,"Matrices");
-    //std::cout << glGetError() << "\n";
-    if (index != GL_INVALID_INDEX)
-    {
-        glUniformBlockBinding(program, index, 0);
-    }
-
+    return layer != -1;
 }
-
-void ViewPort::update()
+std::string Sprite::getSource() const
 {
-    glBindBuffer(GL_UNIFORM_BUFFER,UBO);
-
-    uniforms.cameraZ = currentCamera ? currentCamera->getPos().z : 1;
-    uniforms.viewMatrix = getViewMatrix();
-
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(UBOContents), &uniforms);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, UBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return source;
 }
 
-void ViewPort::setViewRange(const ViewRange& range)
+bool Sprite::getTransluscent() const
 {
-    currentRange = range;
-    uniforms.perspectiveMatrix = getProjMatrix();
+    return alpha.type == ALPHA_TRANSLUSCENT;
 }
 
-void ViewPort::resetUniforms()
+AlphaClass Sprite::getAlphaClass() const
 {
-    glBindBuffer(GL_UNIFORM_BUFFER,UBO);
+    return alpha.type;
+}
 
-    //reset all values in uniforms
-    uniforms.cameraZ = currentCamera ? currentCamera->getPos().z : ViewPort::getViewDepth();
-    uniforms.perspectiveMatrix = getProjMatrix();
-    uniforms.viewMatrix = getViewMatrix();
-    uniforms.screenDimen = glm::vec2(screenWidth,screenHeight);
+const glm::ivec4& Sprite::getOpaqueBounds() const
+{
+    return alpha.bounds;
+}
 
-    //pass the uniforms
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(UBOContents), &uniforms, GL_STATIC_DRAW); // allocate enough memory for two 4x4 matricies and the camera position. Remember that a glm::vec4 is 16 bytes, so each matrix is 64 bytes
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, UBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+Sprite::LoadState Sprite::getLoadState() const
+{
+    return state;
 }
 
-/*void RenderProgram::drawInstanced(Buffer sprite, void* data, int instances)
+glm::vec2 Sprite::getDimen() const
 {
-    glBindVertexArray(VAO);
-    glBindTexture(GL_TEXTURE_2D,sprite);
+    return {width,height};
+}
 
-    if (data)
+size_t SpriteLoader::uploadBudget = 4*1024*1024;
+std::vector<std::thread> SpriteLoader::workers;
+std::deque<SpriteLoader::Job> SpriteLoader::jobs;
+std::vector<SpriteLoader::Upload> SpriteLoader::decoded;
+std::deque<SpriteLoader::Upload> SpriteLoader::uploads;
+std::unordered_map<Sprite*,unsigned int> SpriteLoader::loading;
+std::mutex SpriteLoader::mutex;
+std::condition_variable SpriteLoader::jobAdded;
+std::condition_variable SpriteLoader::jobDecoded;
+bool SpriteLoader::stopping = false;
+unsigned int SpriteLoader::nextID = 0;
+unsigned int SpriteLoader::placeholder = 0;
+Buffer SpriteLoader::PBO = 0;
+
+//joins the workers before their std::threads are destroyed, which would otherwise terminate the program. Has to be defined after SpriteLoader's members
+static struct SpriteLoaderShutdown
+{
+    ~SpriteLoaderShutdown()
     {
-        glBindBuffer(GL_ARRAY_BUFFER,VBO);
-        glBufferData(GL_ARRAY_BUFFER,dataAmount*instances,data,GL_DYNAMIC_DRAW);
+        SpriteLoader::shutdown();
     }
+} spriteLoaderShutdown;
 
-    use();
-
-    glDrawArraysInstanced(GL_TRIANGLES,0,6,instances);
-
-    //glDrawElementsInstanced(GL_TRIANGLES,6,GL_UNSIGNED_INT,indices,instances);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER,0);
-}*/
-
-RenderCamera::~RenderCamera()
+void SpriteLoader::init(unsigned int threads)
 {
-    if (ViewPort::currentCamera == this)
+    std::unique_lock<std::mutex> lock(mutex);
+    if (workers.size() > 0)
     {
-        ViewPort::currentCamera = 0;
+        return;
+    }
+    if (threads == 0)
+    {
+        threads = std::max(2u,std::thread::hardware_concurrency()) - 1;
+    }
+    stopping = false;
+    for (unsigned int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(work);
     }
 }
 
-void RenderCamera::init(const glm::vec3& pos_)
-{
-    setPos(pos_);
-}
-
-const glm::vec3& RenderCamera::getPos() const
+void SpriteLoader::load(Sprite& sprite, const std::string& source, bool atlased)
 {
-    return pos;
-}
+    if (!GLContext::isContextValid())
+    {
+        throw std::runtime_error("Can't load sprite " + source + " without an OpenGL context");
+    }
+    init();
+    cancel(sprite);
 
-glm::vec2 RenderCamera::getTopLeft() const
-{
-    glm::vec2 dimen = ViewPort::getScreenDimen();
+    //we can read the size right away, it's only a few bytes at the start of the file
+    int channels = 0;
+    if (!stbi_info(source.c_str(),&sprite.width,&sprite.height,&channels))
+    {
+        sprite.width = 0;
+        sprite.height = 0;
+    }
+    sprite.state = Sprite::LOADING;
+    sprite.alpha = AlphaInfo(); //the placeholder is opaque
+    sprite.atlasRect = {0,0,1,1};
+    sprite.layer = -1;
+    if (atlased)
+    {
+        SpriteAtlas::atlas.getPlaceholder(sprite.layer,sprite.atlasRect);
+    }
+    else
+    {
+        if (!placeholder)
+        {
+            unsigned char grey[4] = {128,128,128,255};
+            glGenTextures(1,&placeholder);
+            GLState::bindTexture(GL_TEXTURE_2D,placeholder);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,1,1,0,GL_RGBA,GL_UNSIGNED_BYTE,grey);
+            GLState::bindTexture(GL_TEXTURE_2D,0);
+        }
+        sprite.texture = placeholder;
+    }
 
-    return {pos.x - dimen.x/2, pos.y - dimen.y/2};
+    std::unique_lock<std::mutex> lock(mutex);
+    loading[&sprite] = nextID;
+    jobs.push_back({&sprite,nextID,source,atlased});
+    nextID++;
+    jobAdded.notify_one();
 }
 
-glm::vec4 RenderCamera::getRect() const
+void SpriteLoader::cancel(Sprite& sprite)
 {
-    glm::vec2 dimen = ViewPort::getScreenDimen();
-    return glm::vec4(getTopLeft(), dimen.x,dimen.y);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (loading.erase(&sprite) == 0)
+        {
+            return;
+        }
+        //workers skip jobs that aren't in "loading" anymore, so there's no need to search "jobs" or "decoded"
+    }
+    for (auto it = uploads.begin(); it != uploads.end(); ++it)
+    {
+        if (it->job.sprite == &sprite)
+        {
+            //anything already uploaded is wasted. Atlas space can't be given back, but our own texture can
+            if (it->texture)
+            {
+                GLState::deleteTexture(it->texture);
+            }
+            uploads.erase(it);
+            break;
+        }
+    }
 }
 
-void RenderCamera::setPos(const glm::vec3& pos_)
+void SpriteLoader::update()
 {
-    pos = pos_;
+    upload(uploadBudget);
 }
 
-void RenderCamera::setPos(const glm::vec2& pos_)
+void SpriteLoader::wait(const std::vector<Sprite*>& sprites)
 {
-    pos = glm::vec3(pos_,pos.z);
+    auto isDone = [&sprites](){
+        for (Sprite* sprite : sprites)
+        {
+            if (loading.find(sprite) != loading.end())
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (isDone())
+            {
+                return;
+            }
+            if (uploads.empty())
+            {
+                jobDecoded.wait(lock,[](){ return decoded.size() > 0; });
+            }
+        }
+        upload(std::numeric_limits<size_t>::max());
+    }
 }
 
-void RenderCamera::addVector(const glm::vec2& vec)
+void SpriteLoader::waitAll()
 {
-    setPos(glm::vec3(pos.x + vec.x, pos.y + vec.y, pos.z));
+    while (getPending() > 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (uploads.empty())
+            {
+                jobDecoded.wait(lock,[](){ return decoded.size() > 0; });
+            }
+        }
+        upload(std::numeric_limits<size_t>::max());
+    }
 }
 
-void RenderCamera::addVector(const glm::vec3& vec)
+size_t SpriteLoader::getPending()
 {
-    setPos(pos + vec);
+    std::unique_lock<std::mutex> lock(mutex);
+    return loading.size();
 }
 
-bool isTransluscent(unsigned char* sprite, int width, int height)
+void SpriteLoader::shutdown()
 {
-    for (int i = 3; i < width*height*4; i +=4)
     {
-        if (sprite[i] != 255)
-        {
-        //note: it's possible to make this check for alpha values of 0 as well, and then discard fragments of pure transparency in the shader,
-        //to avoid z-sorting. the issue is that as long as sprites use GL_LINEAR instead of GL_NEAREST for
-        //GL_TEXTURE_MIN_FILTER and GL_TEXTURE_MAG_FILTER, a purely opaque or transparent image might have
-        //blurred pixels due to linear interpolation.
-            return true;
-        }
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
     }
-    return false;
+    jobAdded.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
 }
 
+bool SpriteLoader::isLoading(Sprite* sprite, unsigned int id)
+{
+    auto found = loading.find(sprite);
+    return found != loading.end() && found->second == id;
+}
 
-   void Sprite::load(std::string source)
+void SpriteLoader::work()
+{
+    while (true)
     {
-        if (GLContext::isContextValid())
+        Upload result;
         {
-            glGenTextures(1, &texture);
-            glBindTexture(GL_TEXTURE_2D,texture);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-
-            int channels = 0;
-            //auto imageData = cv::imread(source);
-            unsigned char* data = stbi_load(source.c_str(),&width, &height, &channels, 0);
-            int rgb = 0;// GL_RGB*!transparent + GL_RGBA*transparent;
-            switch (channels)
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAdded.wait(lock,[](){ return stopping || jobs.size() > 0; });
+            if (stopping)
             {
-            case 1:
-                rgb = GL_RED;
-                break;
-            case 2:
-                rgb = GL_RG;
-                break;
-            case 3:
-                rgb = GL_RGB;
-                break;
-            case 4:
-                rgb = GL_RGBA;
-                transluscent = isTransluscent(data,width,height);
-                //std::cout << source << " " << transluscent << "\n";
-                break;
+                return;
+            }
+            result.job = jobs.front();
+            jobs.pop_front();
+            if (!isLoading(result.job.sprite,result.job.id)) //cancelled
+            {
+                continue;
             }
+        }
 
+        //the atlas is always RGBA
+        int desiredChannels = result.job.atlased ? 4 : 0;
+        TextureCache::Image cached;
+        unsigned char* data = nullptr;
+        if (TextureCache::load(result.job.source,desiredChannels,cached))
+        {
+            result.width = cached.width;
+            result.height = cached.height;
+            result.channels = cached.channels;
+            result.alpha = cached.alpha;
+            data = const_cast<unsigned char*>(cached.levels[0]);
+        }
+        else
+        {
+            data = stbi_load(result.job.source.c_str(),&result.width,&result.height,&result.channels,desiredChannels);
             if (data)
             {
-                glTexImage2D(GL_TEXTURE_2D, 0, rgb,width, height, 0, rgb, GL_UNSIGNED_BYTE, data);
-                glGenerateMipmap(GL_TEXTURE_2D);
+                result.channels = result.job.atlased ? 4 : result.channels;
+                result.alpha = result.channels == 4 ? classifyAlpha(data,result.width,result.height) : AlphaInfo{ALPHA_OPAQUE,{0,0,result.width,result.height}};
+                if (TextureCache::isEnabled())
+                {
+                    TextureCache::save(result.job.source,desiredChannels,data,result.width,result.height,result.channels,result.alpha);
+                }
+            }
+        }
+        if (data)
+        {
+            if (result.job.atlased)
+            {
+                result.pixels = SpriteAtlas::pad(data,result.width,result.height);
             }
             else
             {
-                std::cout << "Error loading texture: " << source << std::endl;
+                result.pixels.assign(data,data + result.width*result.height*result.channels);
+            }
+            if (!cached.file.getData())
+            {
+                stbi_image_free(data);
             }
-            stbi_image_free(data);
         }
-        else
+
+        std::unique_lock<std::mutex> lock(mutex);
+        decoded.push_back(std::move(result));
+        jobDecoded.notify_all();
+    }
+}
+
+size_t SpriteLoader::upload(size_t budget)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (Upload& upload : decoded)
         {
-            throw std::runtime_error("WOAW MISS\n\nPUMP THE BRAKES\n\nARE YOU TRYING TO INITIALIZE A SPRITE WITHOUT AN OPENGL CONTEXT???\n\nI'm going to have to respectfully decline\n\nYou can\'t initialize textures before initializing an OpenGL Context(https://www.khronos.org/opengl/wiki/Common_Mistakes#The_Object_Oriented_Language_Problem)");
+            if (isLoading(upload.job.sprite,upload.job.id))
+            {
+                uploads.push_back(std::move(upload));
+            }
+        }
+        decoded.clear();
+    }
+    size_t uploaded = 0;
+    while (uploads.size() > 0 && uploaded < budget)
+    {
+        Upload& front = uploads.front();
+        uploaded += uploadSlice(front,budget - uploaded);
+        if (front.pixels.empty() || front.rows == front.height)
+        {
+            finish(front);
+            uploads.pop_front();
+        }
+    }
+    return uploaded;
+}
+
+size_t SpriteLoader::uploadSlice(Upload& upload, size_t budget)
+{
+    if (upload.pixels.empty())
+    {
+        return 0;
+    }
+    Job& job = upload.job;
+    int rowWidth = upload.width + (job.atlased ? 2*SpriteAtlas::PADDING : 0); //pixels per row of "pixels"
+    if (!upload.started)
+    {
+        upload.started = true;
+        int height = upload.height + (job.atlased ? 2*SpriteAtlas::PADDING : 0);
+        if (job.atlased && !SpriteAtlas::atlas.reserve(upload.width,upload.height,upload.layer,upload.atlasRect,upload.corner))
+        {
+            std::cout << "Atlas is full, giving sprite its own texture: " << job.source << std::endl;
+            //take the padding back off
+            std::vector<unsigned char> unpadded(upload.width*upload.height*4);
+            for (int y = 0; y < upload.height; ++y)
+            {
+                memcpy(&unpadded[y*upload.width*4],&upload.pixels[((y + SpriteAtlas::PADDING)*rowWidth + SpriteAtlas::PADDING)*4],upload.width*4);
+            }
+            upload.pixels.swap(unpadded);
+            job.atlased = false;
+            rowWidth = upload.width;
+            height = upload.height;
         }
+        if (!job.atlased)
+        {
+            upload.layer = -1;
+            glGenTextures(1,&upload.texture);
+            GLState::bindTexture(GL_TEXTURE_2D,upload.texture);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+            GLenum formats[] = {GL_RED,GL_RG,GL_RGB,GL_RGBA};
+            GLenum format = formats[upload.channels - 1];
+            glTexImage2D(GL_TEXTURE_2D,0,format,upload.width,upload.height,0,format,GL_UNSIGNED_BYTE,nullptr);
+            GLState::bindTexture(GL_TEXTURE_2D,0);
+        }
+        //uploads count as rows of the padded image for atlased sprites
+        upload.height = height;
     }
 
-Sprite::Sprite( std::string source)
+    size_t rowBytes = rowWidth*upload.channels;
+    int rows = std::min(static_cast<size_t>(upload.height - upload.rows),std::max(static_cast<size_t>(1),budget/rowBytes));
+    size_t bytes = rows*rowBytes;
+
+    if (!PBO)
     {
-        init(source);
+        glGenBuffers(1,&PBO);
     }
-    Sprite::~Sprite()
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER,PBO);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER,bytes,nullptr,GL_STREAM_DRAW); //orphan the last slice rather than waiting for the GPU to finish reading it
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,0,bytes,GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    const unsigned char* source = &upload.pixels[upload.rows*rowBytes];
+    if (mapped)
     {
-        /*if there is no opengl context glDeleteTextures crashes. "context" = false means that our main function has ended, in which case there is no longer
-        a guarnatee to be an openGL context (and the OS will free our memory anyway) so don't delete the texture*/
-        //if (GLContext::isContextValid())
-        //glDeleteTextures(1,&texture);
+        memcpy(mapped,source,bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        source = nullptr; //offset 0 into the PBO
     }
-
-void Sprite::init(std::string source_)
+    else
     {
-        load(source_);
-        source = source_;
+        //couldn't map, upload straight from our own memory instead. Slower, but the slice still goes up, so the sprite can't get stuck loading
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
     }
-unsigned int Sprite::getTexture() const
-{
-    return texture;
-}
-std::string Sprite::getSource() const
-{
-    return source;
-}
-
-bool Sprite::getTransluscent() const
-{
-    return transluscent;
+    if (job.atlased)
+    {
+        SpriteAtlas::atlas.upload(source,upload.layer,upload.corner + glm::ivec2(0,upload.rows),rowWidth,rows);
+    }
+    else
+    {
+        GLenum formats[] = {GL_RED,GL_RG,GL_RGB,GL_RGBA};
+        GLState::bindTexture(GL_TEXTURE_2D,upload.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT,1); //rows of RGB images aren't always a multiple of 4 bytes
+        glTexSubImage2D(GL_TEXTURE_2D,0,0,upload.rows,upload.width,rows,formats[upload.channels - 1],GL_UNSIGNED_BYTE,source);
+        glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+        GLState::bindTexture(GL_TEXTURE_2D,0);
+    }
+    upload.rows += rows;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+    return bytes;
 }
 
-glm::vec2 Sprite::getDimen() const
+void SpriteLoader::finish(Upload& upload)
 {
-    return {width,height};
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        loading.erase(upload.job.sprite);
+    }
+    jobDecoded.notify_all();
+    Sprite& sprite = *upload.job.sprite;
+    if (upload.pixels.empty())
+    {
+        std::cout << "Error loading texture: " << upload.job.source << std::endl;
+        sprite.state = Sprite::FAILED; //keep the placeholder
+        return;
+    }
+    if (!upload.job.atlased)
+    {
+        GLState::bindTexture(GL_TEXTURE_2D,upload.texture);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        GLState::bindTexture(GL_TEXTURE_2D,0);
+    } //the atlas regenerates its own mipmaps in SpriteAtlas::update
+    sprite.texture = upload.texture;
+    sprite.layer = upload.layer;
+    sprite.atlasRect = upload.atlasRect;
+    sprite.alpha = upload.alpha;
+    sprite.state = Sprite::LOADED;
 }
 
 Sprite9::Sprite9(std::string source, glm::vec2 W, glm::vec2 H) : Sprite(source)
@@ -910,6 +3051,34 @@ void Sprite9::init(std::string source,glm::vec2 W, glm::vec2 H)
     heights = H;
 }
 
+void Sprite9::request(const glm::vec4& rect, ZType z, float radians, const glm::vec4& tint, BasicRenderPipeline& pipeline)
+{
+    SpriteManager::requestSprite({pipeline,this},rect,z,radians,tint,glm::vec4(widths,heights));
+}
+
+const float* Sprite9::getVerticies()
+{
+    static float verticies[54*4];
+    static bool filled = false;
+    if (!filled)
+    {
+        const float corners[12] = {0,0, 1,0, 0,1, 1,0, 0,1, 1,1}; //same order as basicScreenCoords
+        for (int region = 0; region < 9; ++region)
+        {
+            for (int i = 0; i < 6; ++i)
+            {
+                float* vertex = verticies + (region*6 + i)*4;
+                vertex[0] = corners[i*2];
+                vertex[1] = corners[i*2 + 1];
+                vertex[2] = region%3; //column
+                vertex[3] = region/3; //row
+            }
+        }
+        filled = true;
+    }
+    return verticies;
+}
+
 
 /*void Sprite9::loadData(GLfloat* data, const SpriteParameter& parameter, int index)
 {
@@ -984,94 +3153,360 @@ glm::vec4 BaseAnimation::normalizePixels(const glm::vec4& rect, Sprite& sprite)
     return answer;
 }
 
-void TransManager::request(const RenderRequest& request, ZType z)
+TransManager::TransManager(bool opaque_) : opaque(opaque_)
+{
+
+}
+
+uint64_t TransManager::getSortKey(const RenderRequest& request, ZType z) const
+{
+    uint64_t zBits = static_cast<uint32_t>(z) ^ 0x80000000u; //flip the sign bit so negative zs come before positive ones when compared as unsigned
+    uint64_t program = request.program.getID() & 0xFFF;
+    uint64_t texture = (request.sprite ? request.sprite->getTexture() : 0) & 0xFFFF;
+    uint64_t batch = (program << 20) | (texture << 4) | (request.mode & 0xF);
+    if (opaque)
+    {
+        //batch first, then front to back (largest z first). Equal zs stay in request order, so with GL_LEQUAL the last one requested wins,
+        //exactly like it would have if it were sorted with the transluscents
+        return (batch << 32) | (~zBits & 0xFFFFFFFFu);
+    }
+    return (zBits << 32) | batch;
+}
+
+void TransManager::request(const RenderRequest& request, ZType z, unsigned int order)
+{
+    if (requests.size() > 0 && order < requests.back().order)
+    {
+        inOrder = false;
+    }
+    keys.push_back({getSortKey(request,z),static_cast<unsigned int>(requests.size())});
+    requests.push_back({request,z,data.size(),order});
+}
+
+void TransManager::absorb(TransManager& other)
+{
+    if (other.requests.size() == 0)
+    {
+        return;
+    }
+    if (requests.size() > 0 && other.requests.front().order < requests.back().order)
+    {
+        inOrder = false;
+    }
+    inOrder = inOrder && other.inOrder;
+
+    if (requests.size() == 0 && opaque == other.opaque)
+    {
+        //usually only one thread made requests, no need to copy anything
+        data.swap(other.data);
+        requests.swap(other.requests);
+        keys.swap(other.keys);
+    }
+    else
+    {
+        size_t offset = data.size();
+        unsigned int first = requests.size();
+        data.insert(data.end(),other.data.begin(),other.data.end());
+        for (auto it = other.requests.begin(); it != other.requests.end(); ++it)
+        {
+            requests.push_back({it->request,it->z,it->index + offset,it->order});
+        }
+        if (opaque == other.opaque) //same keys, they just have to point to where the requests are now
+        {
+            for (auto it = other.keys.begin(); it != other.keys.end(); ++it)
+            {
+                keys.push_back({it->key,it->request + first});
+            }
+        }
+        else
+        {
+            for (size_t i = first; i < requests.size(); ++i)
+            {
+                keys.push_back({getSortKey(requests[i].request,requests[i].z),static_cast<unsigned int>(i)});
+            }
+        }
+    }
+    other.requests.clear();
+    other.keys.clear();
+    other.data.clear();
+    other.inOrder = true;
+}
+
+bool TransManager::isOpaque() const
 {
-    requests.push_back({request,z,data.size()});
+    return opaque;
 }
 
 void TransManager::render()
 {
-    requests.sort();
+    if (!inOrder)
+    {
+        //requests from different threads were merged out of order. Radix sort is stable, so sorting by order first makes it the tie breaker for the real sort
+        radixSort(keys,scratch,[this](const SortKey& key){
+                  return requests[key.request].order;
+                  });
+    }
+    radixSort(keys,scratch,[](const SortKey& key){
+              return key.key;
+              });
 
-    int instances = 0; //technically can calculate this without making a new variable, but this is more readable
-    for (auto it = requests.begin(); it != requests.end(); ++it)
+    size_t size = keys.size();
+    size_t begin = 0;
+    while (begin < size)
     {
-        //buffer.insert(buffer.end(),&data[it->index],&data[it->index] + it->request.program.getBytesPerRequest()); //for each request, store the data into buffer
-        it->request.program.packData(buffer,&data[it->index]);
-        instances++;
-        if (std::next(it) == requests.end() || !(std::next(it)->request == it->request)) //if we have run out of requests, or if the next request requires a different sprite/renderprogram
+        const RenderRequest& current = requests[keys[begin].request].request;
+        size_t end = begin + 1;
+        batchTextures.clear();
+        if (current.program.hasDrawIDs() && current.sprite && current.sprite->getTarget() == GL_TEXTURE_2D)
+        {
+            //sprites with different textures can share a batch as long as there's a texture unit left for each of them. The draw id tells each instance which one is its
+            batchTextures.push_back(current.sprite->getTexture());
+            while (end < size)
+            {
+                const RenderRequest& next = requests[keys[end].request].request;
+                if (&next.program != &current.program || next.mode != current.mode || !next.sprite || next.sprite->getTarget() != GL_TEXTURE_2D)
+                {
+                    break;
+                }
+                GLuint texture = next.sprite->getTexture();
+                if (texture != batchTextures.back() && std::find(batchTextures.begin(),batchTextures.end(),texture) == batchTextures.end())
+                {
+                    if (batchTextures.size() == BasicRenderPipeline::DRAW_TEXTURES)
+                    {
+                        break;
+                    }
+                    batchTextures.push_back(texture);
+                }
+                end++;
+            }
+        }
+        else
         {
-            /*std::cout << it->sprite.getSource() << ": ";
-            for (int i = 0; i < buffer.size(); i += sizeof(float))
+            while (end < size && requests[keys[end].request].request == current) //find where the batch ends, so we know how much room to make before packing it
             {
-                int f;
-                memcpy(&f,&buffer[i],sizeof(float));
-                std::cout << f << " ";
+                end++;
             }
-            std::cout << "\n";*/
-            render(it->request,buffer,instances); //draw
-            instances = 0;
-            buffer.clear(); //clear our buffer
         }
+        render(begin,end);
+        begin = end;
     }
     requests.clear();
+    keys.clear();
     data.clear();
+    inOrder = true;
 }
 
-void TransManager::render(const RenderRequest& request, RenderPayload& payload, int instances)
+void TransManager::render(size_t begin, size_t end)
 {
-    glBindVertexArray(request.program.getVAO());
-    if (request.sprite)
+    const RenderRequest& request = requests[keys[begin].request].request;
+    int instances = end - begin;
+    GLState::bindVertexArray(request.program.getVAO());
+    for (size_t i = 0; i < batchTextures.size(); ++i)
+    {
+        GLState::bindTexture(GL_TEXTURE_2D,batchTextures[i],i);
+    }
+    if (request.sprite && batchTextures.size() == 0)
     {
-        glBindTexture(GL_TEXTURE_2D,request.sprite->getTexture());
+        GLState::bindTexture(request.sprite->getTarget(),request.sprite->getTexture());
     }
 
-    request.program.bufferPayload(payload);
+    GLuint base = request.program.beginBatch(instances);
+    size_t drawID = request.program.getBytesPerRequest() - sizeof(float); //where the draw id goes, if we have one
+    GLuint lastTexture = batchTextures.size() > 0 ? batchTextures[0] : 0;
+    float slot = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+        const TransRequest& current = requests[keys[i].request];
+        if (batchTextures.size() > 0)
+        {
+            GLuint texture = current.request.sprite->getTexture();
+            if (texture != lastTexture) //usually the same as the last one, since the sort puts them next to each other
+            {
+                slot = std::find(batchTextures.begin(),batchTextures.end(),texture) - batchTextures.begin();
+                lastTexture = texture;
+            }
+            memcpy(data.data() + current.index + drawID,&slot,sizeof(float));
+        }
+        request.program.packInstance(i - begin,data.data() + current.index);
+    }
+    GPUProfiler::begin(request.program.getID());
+    request.program.endBatch();
 
-    glUseProgram(request.program.getProgram());
+    request.program.use(); //uploads whatever uniforms were set since this pipeline was last drawn
+    request.program.setDiscardBelow(opaque ? 0.5f : 0); //opaques can have cutout sprites in them
 
     //glDrawArraysInstanced(program.mode,0,program.vertexAmount,size/program.dataAmount);
-    glDrawArraysInstanced(request.mode,0,request.program.vertexAmount,instances);
+    request.program.drawInstanced(request.mode,instances,base);
+    GPUProfiler::end();
+    //nothing gets unbound, the next batch usually wants the same program and often the same VAO and texture. SpriteManager::render unbinds the VAO at the end
+}
 
+TransManager SpriteManager::trans;
+TransManager SpriteManager::opaques(true);
+std::vector<std::unique_ptr<SpriteManager::RecordBuffer>> SpriteManager::buffers;
+std::mutex SpriteManager::buffersMutex;
+CullStats SpriteManager::cullStats;
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER,0);
+const CullStats& SpriteManager::getCullStats()
+{
+    return cullStats;
 }
 
-TransManager SpriteManager::trans;
+SpriteManager::RecordBuffer& SpriteManager::getBuffer()
+{
+    struct Owner //hands the buffer back when its thread exits. Whatever it recorded is still rendered
+    {
+        RecordBuffer* buffer = nullptr;
+        ~Owner()
+        {
+            if (buffer)
+            {
+                std::lock_guard<std::mutex> lock(buffersMutex);
+                buffer->inUse = false;
+            }
+        }
+    };
+    thread_local Owner owner;
+    if (!owner.buffer)
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        for (auto it = buffers.begin(); it != buffers.end(); ++it)
+        {
+            if (!(*it)->inUse)
+            {
+                owner.buffer = it->get();
+                owner.buffer->inUse = true;
+                break;
+            }
+        }
+        if (!owner.buffer)
+        {
+            buffers.emplace_back(new RecordBuffer());
+            owner.buffer = buffers.back().get();
+        }
+    }
+    return *owner.buffer;
+}
+
+void SpriteManager::setRecordOrder(unsigned int order)
+{
+    RecordBuffer& buffer = getBuffer();
+    buffer.order = order;
+    buffer.tagged = true;
+}
+
+void SpriteManager::fillAtlasInfo(const Sprite& sprite, char* bytes)
+{
+    float layer = sprite.getLayer();
+    memcpy(bytes,&sprite.getAtlasRect(),sizeof(glm::vec4));
+    memcpy(bytes + sizeof(glm::vec4),&layer,sizeof(float));
+}
 
 void SpriteManager::render()
 {
+    SpriteLoader::update();
+    SpriteAtlas::atlas.update(); //sprites may have been added to the atlas since last frame
+
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex); //no one should be recording right now, but a thread could still be exiting
+        cullStats = CullStats();
+        int untagged = 0; //threads that recorded without setRecordOrder, whose ties with each other depend on scheduling
+        for (auto it = buffers.begin(); it != buffers.end(); ++it)
+        {
+            if (!(*it)->tagged && ((*it)->trans.data.size() > 0 || (*it)->opaques.data.size() > 0))
+            {
+                untagged++;
+            }
+            (*it)->tagged = false;
+            trans.absorb((*it)->trans);
+            opaques.absorb((*it)->opaques);
+            (*it)->order = 0;
+            cullStats.culled += (*it)->cullStats.culled;
+            cullStats.kept += (*it)->cullStats.kept;
+            (*it)->cullStats = CullStats();
+        }
+        static bool warned = false;
+        if (untagged > 1 && !warned)
+        {
+            std::cerr << "SpriteManager::render: " << untagged << " threads recorded without SpriteManager::setRecordOrder, so ties between them aren't deterministic" << std::endl;
+            warned = true;
+        }
+    }
+
+    if (glIsEnabled(GL_DEPTH_TEST))
+    {
+        //opaques go first so the depth test can throw out everything behind them, including transluscent fragments.
+        //Transluscents at the same z as an opaque are drawn over it, since they come after and we use GL_LEQUAL
+        bool blend = GLState::isBlending();
+        GLState::setBlend(false); //nothing to blend, might as well save the GPU the trouble
+        glDepthMask(GL_TRUE);
+
+        opaques.render();
+
+        GLState::setBlend(blend);
+    }
+    else
+    {
+        //without the depth test, opaques have to be sorted like everything else or they'd be drawn over things in front of them
+        trans.absorb(opaques);
+    }
 
     trans.render();
+    GLState::bindVertexArray(0); //TransManager leaves the last batch's VAO bound
 }
 
 unsigned int PolyRender::VAO = -1;
 unsigned int PolyRender::lineVBO = -1;
-unsigned int PolyRender::polyVBO = -1;
-unsigned int PolyRender::colorVBO = -1;
+Buffer PolyRender::polyVBOs[StreamBuffer::FRAMES];
+Buffer PolyRender::polyEBOs[StreamBuffer::FRAMES];
+size_t PolyRender::polyVBOSizes[StreamBuffer::FRAMES] = {};
+size_t PolyRender::polyEBOSizes[StreamBuffer::FRAMES] = {};
+std::vector<PolyRender::PolyChunk> PolyRender::polyChunks;
 unsigned short PolyRender::restart = 65535;
 std::unique_ptr<RenderProgram> PolyRender::polyRenderer;
+std::unique_ptr<RenderProgram> PolyRender::lineRenderer;
+bool PolyRender::antialiasLines = false;
+std::vector<PolyRender::WideLine> PolyRender::wideLines;
+std::unique_ptr<RenderProgram> PolyRender::shapeRenderer;
+std::vector<PolyRender::Shape> PolyRender::shapes;
 std::vector<std::pair<glm::vec3,glm::vec4>> PolyRender::lines;
-PolyStorage<glm::vec4> PolyRender::polyColors;
+PolyStorage<GLuint> PolyRender::polyColors;
 PolyStorage<glm::vec3> PolyRender::polyPoints;
-PolyStorage<GLuint> PolyRender::polyIndices;
+PolyStorage<GLushort> PolyRender::polyIndices;
 int PolyRender::polygonRequests = 0;
+CullStats PolyRender::cullStats;
+CullStats PolyRender::lastCullStats;
 void PolyRender::init(int screenWidth, int screenHeight)
 {
     glGenVertexArrays(1,&VAO);
     glGenBuffers(1,&lineVBO);
-    glGenBuffers(1,&colorVBO);
-    glGenBuffers(1,&polyVBO);
+    glGenBuffers(StreamBuffer::FRAMES,polyVBOs);
+    glGenBuffers(StreamBuffer::FRAMES,polyEBOs);
 
 
 
     polyRenderer = std::make_unique<RenderProgram>(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/polygonVertex.h",
                                                    ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/simpleFragment.h");
+    lineRenderer = std::make_unique<RenderProgram>(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/lineVertex.h",
+                                                   ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/lineFragment.h");
+    if (lineRenderer->getBytesPerRequest() != sizeof(WideLine))
+    {
+        std::cerr << "lineVertex's inputs don't match PolyRender::WideLine!" << std::endl;
+    }
+    shapeRenderer = std::make_unique<RenderProgram>(ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/vertex/shapeVertex.h",
+                                                   ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] + "/shaders/fragment/shapeFragment.h");
+    if (shapeRenderer->getBytesPerRequest() != sizeof(Shape))
+    {
+        std::cerr << "shapeVertex's inputs don't match PolyRender::Shape!" << std::endl;
+    }
 
     glPrimitiveRestartIndex(restart);
     glEnable(GL_PRIMITIVE_RESTART);
 
+    GPUProfiler::setName(GPUProfiler::POLYGON_LINES,"PolyRender lines");
+    GPUProfiler::setName(GPUProfiler::POLYGONS,"PolyRender polygons");
+    GPUProfiler::setName(GPUProfiler::POLYGON_SHAPES,"PolyRender shapes");
+
 }
 
 void PolyRender::requestLine(const glm::vec4& line, const glm::vec4& color, float z, unsigned int thickness)
@@ -1079,25 +3514,46 @@ void PolyRender::requestLine(const glm::vec4& line, const glm::vec4& color, floa
     requestGradientLine(line,color,color,z,thickness);
 }
 
+bool PolyRender::cull(const glm::vec4& rect, float z, float angle)
+{
+    if (!ViewPort::culling)
+    {
+        return false;
+    }
+    if (ViewPort::isVisible(rect,z,angle))
+    {
+        cullStats.kept++;
+        return false;
+    }
+    cullStats.culled++;
+    return true;
+}
+
+const CullStats& PolyRender::getCullStats()
+{
+    return lastCullStats;
+}
+
 void PolyRender::requestGradientLine(const glm::vec4& line, const glm::vec4& color1, const glm::vec4& color2, float z, unsigned int thickness)
 {
-    /*here, we have to draw "thickness" amount of lines, each of which are parallel translated. https://math.stackexchange.com/a/2594547
-    is the full explanation.*/
-    float dist = sqrt(pow(line.y - line.a,2) + pow(line.x - line.z,2)); //distance between 2 lines
-    glm::vec2 perpVector = {-(line.y - line.a)/dist,(line.x - line.z)/dist}; //calculate the unit vector perpendicular to our line
-    for (int i = 0; i < thickness; ++i)
+    float pad = thickness/2.0f;
+    if (cull({std::min(line.x,line.z) - pad,std::min(line.y,line.a) - pad,fabs(line.x - line.z) + 2*pad,fabs(line.y - line.a) + 2*pad},z))
     {
-        glm::vec2 p1 = glm::vec2(line.x,line.y);
-        glm::vec2 p2 = glm::vec2(line.z,line.a);
-        if (thickness > 1) //only do fancy stuff if we have to; for thickness == 1, we don't have to use linear algebra and doing so introduces decimals that can cause inaccuracy
-        {
-            glm::vec2 disp = perpVector*(thickness/2.0f-i); //displacement of both points
-            p1 += disp;
-            p2 += disp;
-        }
-        lines.push_back(std::pair<glm::vec3,glm::vec4>(glm::vec3(p1,z),color1));
-        lines.push_back(std::pair<glm::vec3, glm::vec4>(glm::vec3(p2,z),color2));
+        return;
     }
+    addLine(line,color1,color2,z,thickness);
+}
+
+void PolyRender::addLine(const glm::vec4& line, const glm::vec4& color1, const glm::vec4& color2, float z, unsigned int thickness)
+{
+    if (thickness > 1 || antialiasLines)
+    {
+        //thick lines used to be "thickness" 1 pixel lines side by side. Now lineVertex turns one instance into a quad that's as thick as we want
+        wideLines.push_back({line,color1,color2,(float)thickness,z,antialiasLines ? 1.0f : 0.0f});
+        return;
+    }
+    lines.push_back(std::pair<glm::vec3,glm::vec4>(glm::vec3(line.x,line.y,z),color1));
+    lines.push_back(std::pair<glm::vec3, glm::vec4>(glm::vec3(line.z,line.a,z),color2));
 }
 
 void PolyRender::requestCircleSegment(float segHeight,float angle, const glm::vec4& color,const glm::vec2& center, double radius, bool filled, float z)
@@ -1140,7 +3596,37 @@ void PolyRender::requestCircleSegment(float segHeight,float angle, const glm::ve
 
 void PolyRender::requestCircle( const glm::vec4& color,const glm::vec2& center, double radius, bool filled, float z)
 {
-    requestNGon(360,center,radius,color,0,filled,z,true);
+    //used to be a 360-gon, 360 points and rotatePoints for every circle
+    requestShape(center,radius,0,color,0,filled ? 0 : 1,z);
+}
+
+void PolyRender::requestShape(const glm::vec2& center, float radius, int sides, const glm::vec4& color, float angle, float thickness, float z, float arc)
+{
+    float extent = radius + thickness/2;
+    if (cull({center.x - extent,center.y - extent,2*extent,2*extent},z))
+    {
+        return;
+    }
+    Shape shape;
+    shape.center = center;
+    shape.radius = radius;
+    shape.sides = sides;
+    shape.angle = angle;
+    shape.thickness = thickness;
+    shape.arc = arc;
+    shape.z = z;
+    shape.color = color;
+    shapes.push_back(shape);
+}
+
+void PolyRender::requestRing(const glm::vec2& center, float radius, float thickness, const glm::vec4& color, float z)
+{
+    requestShape(center,radius,0,color,0,thickness,z);
+}
+
+void PolyRender::requestArc(const glm::vec2& center, float radius, float start, float arc, float thickness, const glm::vec4& color, float z)
+{
+    requestShape(center,radius,0,color,start,thickness,z,arc);
 }
 
 glm::vec2 floorVec(const glm::vec2& vec)
@@ -1150,6 +3636,10 @@ glm::vec2 floorVec(const glm::vec2& vec)
 
 void PolyRender::requestRect(const glm::vec4& rect, const glm::vec4& color, bool filled, double angle, float z)
 {
+    if (cull(rect,z,angle))
+    {
+        return;
+    }
     glm::vec2 topLeft = {rect.x,rect.y};
     glm::vec2 topRight = {rect.x + rect.z, rect.y};
     glm::vec2 botLeft = {rect.x,rect.y + rect.a};
@@ -1164,157 +3654,185 @@ void PolyRender::requestRect(const glm::vec4& rect, const glm::vec4& color, bool
     }
     if (filled)
     {
-        int size = getIndiciesNumber(); //the number of indicies minus the restart indicies
+        GLushort first = beginPolygon(4);
+        GLuint packed = packColor(color);
         for (int i = 0;i < 4; ++i)
         {
-            polyColors.push_back(color);
-            polyIndices.push_back(size + i);
+            polyColors.push_back(packed);
+            polyIndices.push_back(first + i);
         }
         polyIndices.push_back(restart);
         polyPoints.push_back({topLeft.x,topLeft.y,z});
         polyPoints.push_back({topRight.x,topRight.y,z});
         polyPoints.push_back({botLeft.x,botLeft.y,z});
         polyPoints.push_back({botRight.x,botRight.y,z});
-        polygonRequests++;
     }
     else
     {
-        requestLine({topLeft.x,topLeft.y,topRight.x,topRight.y},color,z);
-        requestLine({topLeft.x,topLeft.y,botLeft.x,botLeft.y},color,z);
-        requestLine({botLeft.x,botLeft.y,botRight.x,botRight.y},color,z);
-        requestLine({botRight.x,botRight.y,topRight.x,topRight.y},color,z);
+        addLine({topLeft.x,topLeft.y,topRight.x,topRight.y},color,color,z,1);
+        addLine({topLeft.x,topLeft.y,botLeft.x,botLeft.y},color,color,z,1);
+        addLine({botLeft.x,botLeft.y,botRight.x,botRight.y},color,color,z,1);
+        addLine({botRight.x,botRight.y,topRight.x,topRight.y},color,color,z,1);
     }
 }
 
 void PolyRender::requestNGon(int n, const glm::vec2& center, double side, const glm::vec4& color, double angle, bool filled, float z, bool radius)
 {
-    //this function divides a regular NGon into n-2 triangles so we can render them using a triangle strip
-    double cycleAngle = 2.0/n*M_PI;
-    if (radius)
+    //used to be n points on the CPU. Now it's one shapeRenderer instance, which wants the distance from the center to a corner
+    if (!radius)
     {
-        side = 2*side*sin(M_PI/n);
+        side = side/(2*sin(M_PI/n));
         //the angle in the center of a regular polygon divided in half is always M_PI/n, we then use trigonometry to figure out the
-        //length of the side given the radius
+        //radius given the length of the side
     }
-    glm::vec2 first = {center.x - side/2, center.y + side/2/tan(cycleAngle/2)}; //first is the angle we start at and the point we'll be rotating around the center to generate our verticies
-    if (angle != 0)
+    requestShape(center,side,n,color,angle,filled ? 0 : 1,z);
+}
+
+void PolyRender::requestPolygon(const std::vector<glm::vec3>& points, const glm::vec4& color)
+{
+    if (ViewPort::culling && points.size() > 0)
     {
-        first = rotatePoint(first,center,angle);
-    }
-    glm::vec2 next = first; //next is the actual point we'll be adding into the polygons
-   if (filled)
-   {
-        glm::vec2 temp;
-        polyPoints.push_back({first.x,first.y,z});
-        polyColors.push_back(color);
-        int indicies = getIndiciesNumber(); //number of indicies minus restart indicies
-        polyIndices.push_back(indicies);
-        for (int i = 1; i < n; ++i)
+        glm::vec3 minPoint = points[0], maxPoint = points[0];
+        for (auto it = points.begin(); it != points.end(); ++it)
         {
-            temp = next;
-            next = rotatePoint(first, center,cycleAngle*((i%2)*2-1)); //calculate the next point by rotating the previous point
-            first = temp; //track the previous point
-            polyPoints.push_back({next.x,next.y,z});
-            polyColors.push_back(color);
-            polyIndices.push_back(indicies + i);
+            minPoint = glm::min(minPoint,*it);
+            maxPoint = glm::max(maxPoint,*it);
         }
-        polyIndices.push_back(restart);
-        polygonRequests++;
-
-   }
-   else
-   {
-        for (int i = 0; i < n; ++i)
+        //the furthest z has the biggest view, so if we aren't visible there we aren't visible anywhere
+        if (cull({minPoint.x,minPoint.y,maxPoint.x - minPoint.x,maxPoint.y - minPoint.y},minPoint.z))
         {
-            next = rotatePoint(first, center,cycleAngle);
-            requestLine({first.x,first.y,next.x,next.y},color,z);
-            //lines.push_back({{first.x,first.y,next.x,next.y},color},z);
-            first = next;
+            return;
         }
-   }
-
-}
-
-void PolyRender::requestPolygon(const std::vector<glm::vec3>& points, const glm::vec4& color)
-{
-    int size = points.size() - polygonRequests;
-    int indices= polyIndices.size();
+    }
+    if (points.size() >= restart)
+    {
+        std::cerr << "PolyRender::requestPolygon: polygon has " << points.size() << " points, max is " << restart - 1 << std::endl;
+        return;
+    }
+    int size = points.size();
+    GLushort first = beginPolygon(size);
+    GLuint packed = packColor(color);
     for (int i = 0; i < size; ++i)
     {
         polyPoints.push_back(points[i]);
-        polyColors.push_back(color);
-        polyIndices.push_back(indices +i);
+        polyColors.push_back(packed);
+        polyIndices.push_back(first + i);
     }
-    polygonRequests ++;
+    polyIndices.push_back(restart);
     //polygons.push_back({size,color});
 }
 
-void PolyRender::renderLines()
+GLushort PolyRender::beginPolygon(int points)
 {
-    glBindVertexArray(VAO);
-    int size = lines.size();
-    int vertSize = size*3;
-    int colorSize = size*4;
-    size_t floatSize = sizeof(GLfloat);
-    GLfloat* verticies = new GLfloat[size*3];
-    GLfloat* colors = new GLfloat[size*4];
-    for (int i = 0; i < size; i ++)
-    {
-       addPointToBuffer(verticies,lines[i].first,i*3);
-       //std::cout << verticies[i*3] << " " << verticies[i*3 + 1] << " " << verticies[i*3 + 2] << std::endl;
-       addPointToBuffer(colors,lines[i].second,i*4);
-    }
-//std::cout << glGetError() << std::endl;
-    glBindBuffer(GL_ARRAY_BUFFER,lineVBO);
-    glBufferData(GL_ARRAY_BUFFER,vertSize*floatSize,verticies,GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,0,(void*)0);
-    glEnableVertexAttribArray(0);
-    //glVertexAttribDivisor(0,1);
+    //restart is reserved, so a chunk can only have restart - 1 points
+    if (polyChunks.size() == 0 || polyPoints.size() - polyChunks.back().firstPoint + points >= restart)
+    {
+        polyChunks.push_back({(GLint)polyPoints.size(),polyIndices.size()});
+    }
+    polygonRequests++;
+    return polyPoints.size() - polyChunks.back().firstPoint;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
-    glBufferData(GL_ARRAY_BUFFER,colorSize*floatSize, colors, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(1,4,GL_FLOAT,GL_FALSE,0,(void*)0);
-    glEnableVertexAttribArray(1);
-    //glVertexAttribDivisor(1,1);
+GLuint PolyRender::packColor(const glm::vec4& color)
+{
+    glm::vec4 clamped = glm::clamp(color,glm::vec4(0),glm::vec4(1))*255.0f + 0.5f;
+    return (GLuint)clamped.r | ((GLuint)clamped.g << 8) | ((GLuint)clamped.b << 16) | ((GLuint)clamped.a << 24);
+}
 
-    glUseProgram(polyRenderer->getProgram());
+void PolyRender::renderLines()
+{
+    GPUProfiler::begin(GPUProfiler::POLYGON_LINES);
+    if (lines.size() > 0)
+    {
+        //"lines" is already points and colors one after another, so we can hand it to the GPU as is
+        typedef std::pair<glm::vec3,glm::vec4> LinePoint;
+        size_t bytes = lines.size()*sizeof(LinePoint);
+        GLState::bindVertexArray(VAO);
+        GLState::bindBuffer(GL_ARRAY_BUFFER,lineVBO);
+        glBufferData(GL_ARRAY_BUFFER,bytes,lines.data(),GL_STREAM_DRAW);
+        glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(LinePoint),(void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1,4,GL_FLOAT,GL_FALSE,sizeof(LinePoint),(void*)(reinterpret_cast<char*>(&lines[0].second) - reinterpret_cast<char*>(&lines[0])));
+        glEnableVertexAttribArray(1);
 
-    glDrawArrays(GL_LINES,0,size);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER,0);
-    lines.clear();
+        polyRenderer->use();
 
-    delete [] verticies;
-    delete [] colors;
+        glDrawArrays(GL_LINES,0,lines.size());
+        RenderCounters::drawCalls++;
+        RenderCounters::bytesUploaded += bytes;
+        lines.clear();
+    }
+    if (wideLines.size() > 0)
+    {
+        int instances = wideLines.size();
+        GLState::bindVertexArray(lineRenderer->getVAO());
+        GLuint base = lineRenderer->beginBatch(instances); //streams into the same persistently mapped buffer every frame when it can
+        for (int i = 0; i < instances; ++i)
+        {
+            lineRenderer->packInstance(i,reinterpret_cast<const char*>(&wideLines[i]));
+        }
+        lineRenderer->endBatch();
+        lineRenderer->use();
+        lineRenderer->drawInstanced(GL_TRIANGLES,instances,base);
+        wideLines.clear();
+    }
+    GPUProfiler::end();
 }
 
 void PolyRender::renderPolygons()
 {
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER,polyVBO);
-    glBufferData(GL_ARRAY_BUFFER,polyPoints.size()*sizeof(GLfloat)*3,&polyPoints[0],GL_DYNAMIC_DRAW);
+    if (polyPoints.size() == 0)
+    {
+        return;
+    }
+    GPUProfiler::begin(GPUProfiler::POLYGONS);
+    GLState::bindVertexArray(VAO);
+
+    //one set of buffers per StreamBuffer frame. They're only reallocated when a frame has more polygons than ever before,
+    //otherwise we just overwrite the old contents
+    int frame = StreamBuffer::getFrame();
+    size_t pointBytes = polyPoints.size()*sizeof(glm::vec3);
+    size_t colorBytes = polyColors.size()*sizeof(GLuint);
+    size_t indexBytes = polyIndices.size()*sizeof(GLushort);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER,polyVBOs[frame]);
+    if (polyVBOSizes[frame] < pointBytes + colorBytes)
+    {
+        polyVBOSizes[frame] = (pointBytes + colorBytes)*2;
+        glBufferData(GL_ARRAY_BUFFER,polyVBOSizes[frame],nullptr,GL_STREAM_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER,0,pointBytes,&polyPoints[0]);
+    glBufferSubData(GL_ARRAY_BUFFER,pointBytes,colorBytes,&polyColors[0]);
     glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,0,(void*)0);
     glEnableVertexAttribArray(0);
-    //glVertexAttribDivisor(0,1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
-    glBufferData(GL_ARRAY_BUFFER,polyColors.size()*sizeof(GLfloat)*4, &polyColors[0], GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(1,4,GL_FLOAT,GL_FALSE,0,(void*)0);
+    glVertexAttribPointer(1,4,GL_UNSIGNED_BYTE,GL_TRUE,0,(void*)pointBytes);
     glEnableVertexAttribArray(1);
-    //glVertexAttribDivisor(1,1);
 
-    glUseProgram(polyRenderer->getProgram());
-    glDrawElements(GL_TRIANGLE_STRIP,polyIndices.size(),GL_UNSIGNED_INT,&polyIndices[0]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,polyEBOs[frame]); //the element buffer is part of the VAO, so this has to come after binding it
+    if (polyEBOSizes[frame] < indexBytes)
+    {
+        polyEBOSizes[frame] = indexBytes*2;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,polyEBOSizes[frame],nullptr,GL_STREAM_DRAW);
+    }
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,0,indexBytes,&polyIndices[0]);
 
-    glBindBuffer(GL_ARRAY_BUFFER,0);
-    glBindVertexArray(0);
+    polyRenderer->use();
+    for (size_t i = 0; i < polyChunks.size(); ++i)
+    {
+        size_t end = i + 1 < polyChunks.size() ? polyChunks[i + 1].firstIndex : polyIndices.size();
+        glDrawElementsBaseVertex(GL_TRIANGLE_STRIP,end - polyChunks[i].firstIndex,GL_UNSIGNED_SHORT,
+                                 (void*)(polyChunks[i].firstIndex*sizeof(GLushort)),polyChunks[i].firstPoint);
+        RenderCounters::drawCalls++;
+    }
+    RenderCounters::bytesUploaded += pointBytes + colorBytes + indexBytes;
 
 
     polyPoints.clear();
     polyColors.clear();
     polyIndices.clear();
+    polyChunks.clear();
     polygonRequests = 0;
+    GPUProfiler::end();
 
    /* delete[] verticies;
     delete[] colors;
@@ -1322,6 +3840,23 @@ void PolyRender::renderPolygons()
 
 }
 
+void PolyRender::renderShapes()
+{
+    GPUProfiler::begin(GPUProfiler::POLYGON_SHAPES);
+    int instances = shapes.size();
+    GLState::bindVertexArray(shapeRenderer->getVAO());
+    GLuint base = shapeRenderer->beginBatch(instances);
+    for (int i = 0; i < instances; ++i)
+    {
+        shapeRenderer->packInstance(i,reinterpret_cast<const char*>(&shapes[i]));
+    }
+    shapeRenderer->endBatch();
+    shapeRenderer->use();
+    shapeRenderer->drawInstanced(GL_TRIANGLES,instances,base);
+    shapes.clear();
+    GPUProfiler::end();
+}
+
 void PolyRender::renderMesh(float* mesh, int w, int h)
 {
 
@@ -1329,13 +3864,20 @@ void PolyRender::renderMesh(float* mesh, int w, int h)
 
 void PolyRender::render()
 {
-    if (lines.size() > 0)
+    lastCullStats = cullStats;
+    cullStats = CullStats();
+    if (lines.size() > 0 || wideLines.size() > 0)
     {
         renderLines();
     }
-    if (polyColors.size() > 0)
+    if (polyPoints.size() > 0)
     {
         renderPolygons();
     }
+    if (shapes.size() > 0)
+    {
+        renderShapes();
+    }
+    GLState::bindVertexArray(0); //so nothing outside of PolyRender accidentally changes our VAOs
 }
 
@@ -9,6 +9,11 @@
 #include <list>
 #include <forward_list>
 #include <set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <string.h>
 
 #include "glew.h"
 
@@ -43,6 +48,23 @@ Numbers getVertexInputs(const std::string& vertexContents); //given a vertexShad
 //vertex file path only once, and then compile the sahders and load the inputs all at once. Feel free to change this future Leo!
 int loadShaders(const GLchar* source, GLenum shaderType, Numbers* numbers = 0);
 int loadShaders(LoadShaderInfo&& info, Numbers* numbers = 0);
+//loadShaders, split in two. preprocessShader reads the file (if it is one), strips comments, and fills in ${variables} and #includes; the bool is false on failure
+std::pair<std::string,bool> preprocessShader(const LoadShaderInfo& info);
+int compileShader(const std::string& code, GLenum shaderType, const std::string& name); //returns the shader handle or -1 on failure. "name" is for error messages
+
+struct ProgramCache
+{
+    /*caches linked programs on disk with glGetProgramBinary, so we only compile every shader once rather than every launch. Programs are keyed by a hash of
+    their preprocessed sources and the driver (vendor, renderer, and version), so editing a shader or updating the driver just misses the cache. The vertex inputs are
+    cached with the program so we don't have to parse them either. Only on if the "program_cache_dir" config variable is set and the driver supports
+    GL_ARB_get_program_binary; if anything goes wrong we quietly compile from source like normal*/
+    static bool isEnabled();
+    static bool load(GLuint program, const std::vector<LoadShaderInfo>& sources, Numbers& numbers); //"sources" must be preprocessed. Returns true if "program" is now linked
+    static void save(GLuint program, const std::vector<LoadShaderInfo>& sources, const Numbers& numbers); //"program" must be linked
+private:
+    static uint64_t getKey(const std::vector<LoadShaderInfo>& sources);
+    static std::string getPath(uint64_t key);
+};
 
 //using a shader as a template, adds some inputs and outputs. ideal for shaders that do pretty much the same thing but may need to pass an additional output to another shader
 std::string templateShader(const std::string& shaderContents, bool isVertex, std::initializer_list<std::string> inputs, std::initializer_list<std::string> outputs, std::initializer_list<std::string> tasks);
@@ -59,7 +81,7 @@ class GLContext
     static bool context; //true if context is guaranteed to be true;
     static SDL_Window* window;
 public:
-    static void init(int screenWidth, int screenHeight, bool fullscreen = false);
+    static void init(int screenWidth, int screenHeight, bool fullscreen = false, bool hidden = false); //hidden is for rendering offscreen, into a framebuffer of your own
     static bool isContextValid();
     static void update();
     static void terminate();
@@ -88,6 +110,46 @@ struct ViewRange //represents the extent of our view range. y is the furthest, x
 };
 typedef GLuint Buffer;
 
+struct RenderCounters //running totals of the work we hand the GPU. Reset them whenever you want to start measuring, like the start of a frame
+{
+    static unsigned long long drawCalls;
+    static unsigned long long bytesUploaded; //vertex, instance, and uniform data, whether it went through glBufferData or a StreamBuffer
+    static unsigned long long bindsIssued; //binds and state changes GLState actually passed on to GL
+    static unsigned long long bindsSkipped; //binds and state changes GLState threw out because they were already in effect
+    static void reset();
+};
+
+struct GLState //remembers what's bound so we don't ask the driver to bind it again. Only accurate if every bind goes through here;
+               //if you call GL yourself (or delete something that might be bound) call invalidate() afterwards
+{
+    static constexpr int TEXTURE_UNITS = 16;
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint VAO);
+    static void bindBuffer(GLenum target, GLuint buffer); //GL_ARRAY_BUFFER and GL_UNIFORM_BUFFER are tracked, anything else is passed straight through. The element buffer belongs to the VAO so it isn't tracked
+    static void bindTexture(GLenum target, GLuint texture, int unit = 0); //GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY are tracked
+    static void setBlend(bool enabled);
+    static bool isBlending(); //only asks GL if we don't already know
+    static void deleteBuffer(GLuint buffer); //deleting something unbinds it, so these forget it too
+    static void deleteTexture(GLuint texture);
+    static void invalidate(); //forget everything, the next bind of anything is always issued
+private:
+    static constexpr GLuint UNKNOWN = -1;
+    static bool changed(GLuint& current, GLuint value); //true if "value" needs to be bound. Updates "current" and RenderCounters
+    static GLuint program;
+    static GLuint VAO;
+    static GLuint arrayBuffer;
+    static GLuint uniformBuffer;
+    static GLuint activeUnit;
+    static GLuint textures[TEXTURE_UNITS][2]; //[unit][0] is GL_TEXTURE_2D, [unit][1] is GL_TEXTURE_2D_ARRAY
+    static GLuint blend; //0 or 1, or UNKNOWN
+};
+
+struct CullStats //how many requests were thrown out for being off screen, and how many weren't
+{
+    unsigned int culled = 0;
+    unsigned int kept = 0;
+};
+
 const float textureVerticies[24] = { //verticies of textures
     -1, 1, 0, 1, //top left
     1, 1, 1, 1, //top right
@@ -100,19 +162,104 @@ const float textureVerticies[24] = { //verticies of textures
 
 
 
+class StreamBuffer
+{
+    /*a persistently mapped vertex buffer that we write into directly, rather than calling glBufferData every batch. glBufferData forces the driver
+    to reallocate and sync every time, which was most of our frame time. The buffer is split into FRAMES sections; every frame writes into its own section
+    and the section is fenced at the end of the frame, so we never write into memory the GPU might still be reading from.
+    Requires GL_ARB_buffer_storage, check isSupported() before using*/
+public:
+    static constexpr int FRAMES = 3; //triple buffered
+    static bool enabled; //set to false before creating any pipelines to force the old glBufferData path
+    static bool isSupported();
+    static void endFrame(); //fences the current section and moves onto the next one, waiting if the GPU is still reading it. GLContext::update calls this once per frame
+    static int getFrame(); //index of the section every StreamBuffer is currently writing into
+    static unsigned long long getFrameCount(); //number of times endFrame has been called. Useful to find out if a new frame has started
+
+    void init(size_t sectionBytes); //allocate and map "sectionBytes" per section. Calling it again grows the buffer; the old one is deleted, which is safe since GL defers deletion until the GPU is done with it
+    char* getSection(); //pointer to the start of the current frame's section
+    size_t getSectionOffset(); //bytes from the start of the buffer to the current frame's section
+    size_t getCapacity(); //bytes per section
+    Buffer getVBO();
+private:
+    Buffer VBO = 0;
+    char* mapped = nullptr;
+    size_t capacity = 0;
+
+    static GLsync fences[FRAMES];
+    static int frame;
+    static unsigned long long frameCount;
+};
+
+class GPUProfiler
+{
+    /*optional GPU timing. While enabled, every batch TransManager draws and both PolyRender passes are wrapped in a GL_TIME_ELAPSED query, and every frame
+    ends with a GL_TIMESTAMP. Results are only read LATENCY frames later, by which point the GPU is done with them, so we never stall waiting on a query.
+    Times are totaled per pipeline (by BasicRenderPipeline::getID) and PolyRender pass. Requires GL_ARB_timer_query*/
+public:
+    enum Pass //ids for things that aren't pipelines. Pipeline ids start at 0, so these are negative
+    {
+        POLYGON_LINES = -1,
+        POLYGONS = -2,
+        POLYGON_SHAPES = -3
+    };
+    struct Stats
+    {
+        double totalMs = 0; //GPU time spent across every frame we've read back
+        double lastFrameMs = 0; //GPU time spent in the most recent frame we've read back
+        unsigned long long batches = 0; //how many queries were read back
+    };
+    static constexpr int LATENCY = 4; //how many frames old a query is when we read it
+    static bool enabled; //off by default. Can be toggled at any time, queries already in flight are still read back
+    static bool isSupported();
+    static void begin(int id); //starts timing "id". Only one thing can be timed at once
+    static void end();
+    static void endFrame(); //marks the end of a frame and reads back the oldest one. Called by GLContext::update
+    static void setName(int id, const std::string& name); //name to use for "id" in dump
+    static const Stats* getStats(int id); //null if "id" has never been timed
+    static double getTotalMs(); //totalMs of everything we've timed
+    static double getFrameMs(); //GPU time of the most recent frame we've read back, start of one frame to the start of the next
+    static unsigned long long getFramesRead(); //how many frames we've read back
+    static void dump(std::ostream& stream); //one line per pipeline/pass: name, total ms, average ms per frame, batches
+    static void reset(); //forget all stats. Queries in flight are still read back
+private:
+    struct Pending
+    {
+        GLuint query;
+        int id;
+    };
+    static std::vector<Pending> pending[LATENCY]; //queries made during each frame in flight
+    static std::vector<GLuint> pool; //queries that have been read back and can be reused
+    static GLuint timestamps[LATENCY];
+    static bool timestamped[LATENCY]; //false if the frame ended while we were disabled
+    static GLuint64 lastTimestamp; //0 if the previous frame had no timestamp
+    static int frame; //index into "pending" and "timestamps" for the current frame
+    static bool active; //true if begin was called without end
+    static std::map<int,Stats> stats;
+    static std::map<int,std::string> names;
+    static double frameMs;
+    static unsigned long long framesRead;
+    //GPU time of each id in the frame being read back, indexed by id - POLYGON_SHAPES (the lowest pass). -1 if the id wasn't timed that frame.
+    //Kept between frames so reading back doesn't allocate
+    static std::vector<double> frameTimes;
+    static std::vector<int> frameIDs; //ids that have a time in frameTimes
+};
+
 struct VBOInfo
 {
     //stores a VBO and how much data it expects to have per vertex
     size_t floatsPerVertex = 0; //maximum amount of floats per vertex;
-    Buffer VBO;
+    Buffer VBO = 0;
+    StreamBuffer stream; //only used if the pipeline is streaming and this isn't divisor 0
 };
 
 
-//for each type of divisor, we get the corresponding data and VBO
-typedef std::unordered_map<int,VBOInfo> VBOs;
+//for each type of divisor, we get the corresponding data and VBO. Both are indexed by the divisor itself; divisors are tiny so the gaps cost nothing
+typedef std::vector<VBOInfo> VBOs; //divisors no input uses have a floatsPerVertex of 0
 typedef std::vector<char> Bytes;
 typedef std::vector<int> DivisorStorage;
-typedef std::unordered_map<int,Bytes> RenderPayload; //maps divisors to their total data
+typedef std::vector<Bytes> RenderPayload; //each divisor's total data
+typedef int UniformHandle; //index into a pipeline's uniform table, from getUniform. -1 means the uniform doesn't exist
 
 struct BasicRenderPipeline //made for storing simple rendering information
 {
@@ -144,37 +291,133 @@ struct BasicRenderPipeline //made for storing simple rendering information
     void draw(GLenum mode, T t1, Args... args);
 
 
-    void bufferPayload(RenderPayload& payload); //buffers the payload's data in the VBOs in preparation for rendering
+    //buffers the payload's data in the VBOs in preparation for rendering. "instances" is how many requests are in the payload
+    //returns the base instance to draw with, which is always 0 unless we are streaming
+    GLuint bufferPayload(RenderPayload& payload, int instances = 1);
+
+    //the batch path, for when the requests are already bytes laid out like getBytesPerRequest says (see TransManager).
+    //Each request is copied exactly once, straight into the memory the GPU reads (or a staging buffer, if we aren't streaming)
+    GLuint beginBatch(int instances); //makes room for "instances" requests. Returns the base instance to draw with
+    void packInstance(int instance, const char* bytes); //copies the "instance-th" request of the batch into place. Defined below, it's the hottest function we have
+    void endBatch(); //uploads anything that couldn't be written directly. Call before drawing
+    void drawInstanced(GLenum mode, int instances, GLuint baseInstance = 0); //draws "instances" instances starting at "baseInstance". Assumes the VAO and program are bound
+    bool isStreaming(); //true if instanced data is written into persistently mapped StreamBuffers rather than glBufferData
+    //marks this pipeline as drawing atlased sprites. Its last two vertex inputs must be "vec4 atlasRect" and "float atlasLayer", which SpriteManager fills in for you
+    void setAtlased(bool atlased_);
+    bool isAtlased();
+    static constexpr int DRAW_TEXTURES = 8; //most sprites a pipeline with draw ids can draw at once. GL 3.3 guarantees 16 texture units in the fragment shader
+    //marks this pipeline as able to draw sprites with different textures in one call. Its last vertex input must be "float drawID", which TransManager fills in
+    //with the index of the instance's sprite in the fragment shader's "uniform sampler2D sprites[DRAW_TEXTURES]". ViewPort::basicProgram is one
+    void setDrawIDs(bool drawIDs_);
+    bool hasDrawIDs();
+    //fragments with less alpha than this are discarded, if the fragment shader has a "uniform float discardBelow". Assumes the program is bound
+    //TransManager sets it to 0.5 for opaques so cutout sprites can be drawn with them
+    void setDiscardBelow(float alpha);
+    bool canDiscard(); //true if the fragment shader has a discardBelow uniform
+    //marks this pipeline as drawing its sprites' alpha as is, so opaque and cutout sprites can go with the opaques. Off by default;
+    //a pipeline that tints or fades its sprites has to stay off, or its fragments would be drawn solid with blending off
+    void setOpaqueSafe(bool opaqueSafe_);
+    bool isOpaqueSafe();
     int getDivisor(unsigned int index); //get the attrib divisor of the "index-th" attribute
 
-    //set uniforms
-    void setMatrix4fv(std::string name, const GLfloat* value); //pass in the value_ptr of the matrix
-    void setVec3fv(std::string name,glm::vec3 value);
-    void setVec4fv(std::string name, glm::vec4 value);
-    void setVec2fv(std::string name, glm::vec2 value);
+    void use(); //binds the program and uploads every uniform that was set since it was last bound. Use this rather than glUseProgram(getProgram())
+
+    //set uniforms. Values are stored on the pipeline and only uploaded the next time it's bound with use(), so setting them is cheap and doesn't touch GL.
+    //Every active uniform is looked up once when the program is linked. The name overloads are the slow path: they build a std::string and hash it every call.
+    //If you set the same uniform a lot (every frame, say), get its handle once and use the handle overloads
+    UniformHandle getUniform(const std::string& name); //-1 if the program has no active uniform called "name"
+    void setMatrix4fv(UniformHandle uniform, const GLfloat* value); //pass in the value_ptr of the matrix
+    void setVec3fv(UniformHandle uniform, glm::vec3 value);
+    void setVec4fv(UniformHandle uniform, glm::vec4 value);
+    void setVec2fv(UniformHandle uniform, glm::vec2 value);
+    void setMatrix4fv(const std::string& name, const GLfloat* value);
+    void setVec3fv(const std::string& name,glm::vec3 value);
+    void setVec4fv(const std::string& name, glm::vec4 value);
+    void setVec2fv(const std::string& name, glm::vec2 value);
 
     size_t getBytesPerRequest();
+    unsigned int getID(); //unique id for each pipeline, in the order they were created
     Buffer getProgram();
     Buffer getVBO(int divisor);
     Buffer getVAO();
     Buffer getVerticies();
 
     template <typename T,typename... Args>
-    RenderPayload packData(T t1, Args... args); //packs arguments into a RenderPayload based on divisors
-    void packData(RenderPayload& payload, char* bytes ); //packs a series of bytes that is assumed to be the attributes into payload
+    RenderPayload& packData(T t1, Args... args); //packs arguments into a RenderPayload based on divisors. The payload is reused, so it's only valid until the next call
     void initVerticies(const float* verts, int floatsPerVertex_, int vertexAmount); //initiates argument 0, which is assumed to be verticies.
 private:
+    static unsigned int pipelines; //how many pipelines have been created, used to assign ids
+    unsigned int id = pipelines++;
     size_t dataAmount = 1; //number of bytes per request
     Buffer program = 0;
     VBOs vbos;
+    RenderPayload payload; //reused by packData so draw doesn't allocate every call
     Buffer VAO;
     Buffer verticies; //VBO for verticies
+
+    struct Uniform
+    {
+        std::string name; //without the "[0]" arrays get
+        GLint location = -1;
+        GLenum type = GL_FLOAT;
+        float value[16] = {}; //last value set, big enough for a mat4
+        bool set = false; //false until the first set. The shader may give the uniform an initial value, so the first set is always uploaded
+        bool dirty = false; //true if "value" hasn't been uploaded yet
+    };
+    std::vector<Uniform> uniforms; //every active uniform outside of a uniform block, filled in once the program is linked
+    std::unordered_map<std::string,UniformHandle> uniformLookup; //name to index in "uniforms"
+    std::vector<UniformHandle> dirtyUniforms; //uniforms to upload on the next use()
+    void initUniforms(); //fills in "uniforms". Requires a linked program
+    void setUniform(UniformHandle uniform, GLenum type, const float* value, int floats); //stores the value and marks it dirty if it changed or was never set
+
+    bool atlased = false;
+    bool drawIDs = false;
+    bool opaqueSafe = false;
+    GLint discardBelowLocation = -1;
+    float discardBelow = 0; //uniforms start at 0
+    bool streaming = false; //true if we write into persistently mapped StreamBuffers. Requires GL_ARB_buffer_storage and GL_ARB_base_instance
+    size_t streamInstances = 0; //how many instances each StreamBuffer section can hold
+    size_t streamCursor = 0; //how many instances we have already written this frame
+    unsigned long long streamFrame = 0; //the StreamBuffer frame "streamCursor" belongs to
+    void initStreams(size_t instances); //(re)allocates every divisor's StreamBuffer to hold "instances" instances per frame
+
+    struct CopyTarget //where one divisor's data goes during a batch
+    {
+        int divisor = 1;
+        size_t stride = 0; //bytes per instance
+        char* write = nullptr; //where instance 0 of the current batch goes
+        bool streamed = false; //true if "write" points into mapped memory, false if it points into "staging"
+    };
+    struct CopyRun //one contiguous memcpy from a request's bytes into a divisor's data. Neighboring inputs with the same divisor become one run
+    {
+        unsigned int target; //index into "copyTargets"
+        size_t src; //offset into the request's bytes
+        size_t dst; //offset into the instance's data for "target"'s divisor
+        size_t bytes;
+    };
+    std::vector<CopyTarget> copyTargets; //one per divisor
+    std::vector<CopyRun> copyTable; //resolved once in initCopyTable, so packing a request never has to look at "numbers" or "vbos"
+    std::vector<Bytes> staging; //one per copy target, only used for data we can't stream
+    int batchInstances = 0;
+    void initCopyTable();
+
+    void initProgram(LoadShaderInfo* info, size_t count); //compiles and links "program" from "info", or loads it from ProgramCache. Also fills in "numbers"
     void initAttribDivisors(Numbers numbers); //initiates inputs, assuming first input is verticies and already set by "initVerticies"
+    void initAttribPointers(); //points every input at its VBO. Called again whenever a StreamBuffer grows
     void packDataHelper(RenderPayload& payload, int divisorsIndex, int vertexIndex);
     template <typename T,typename... Args>
     void packDataHelper(RenderPayload& payload, int divisorsIndex, int vertexIndex, T t1, Args... args);
 };
 
+inline void BasicRenderPipeline::packInstance(int instance, const char* bytes)
+{
+    for (const CopyRun& run : copyTable)
+    {
+        const CopyTarget& target = copyTargets[run.target];
+        memcpy(target.write + instance*target.stride + run.dst,bytes + run.src,run.bytes);
+    }
+}
+
 using RenderProgram = BasicRenderPipeline;
 
 class RenderCamera;
@@ -187,6 +430,7 @@ struct __attribute__((packed, aligned(1))) UBOContents
     glm::mat4 viewMatrix;
     glm::vec2 screenDimen;
     float cameraZ;
+    Uint32 time; //SDL_GetTicks as of the last ViewPort::update. Lets shaders animate without us sending them anything per sprite
 
     //TODO: Uniform buffers have wack ass layouts. This current structure is set up to avoid any issues but adding more entries may cause them. Look up std140 layout
 
@@ -208,9 +452,20 @@ struct ViewPort //has data about visible area on screen. Make sure you initializ
     static ViewRange currentRange; //represents the current range for x,y, and z
     static std::unique_ptr<BasicRenderPipeline> basicProgram; //generic shader pipeline to render sprites
     static std::unique_ptr<BasicRenderPipeline> animeProgram; //shader pipeline to render spritesheets
+    static std::unique_ptr<BasicRenderPipeline> spriteSheetProgram; //animeProgram, but takes the whole BaseAnimation and picks the frame itself. See BaseAnimationComponent::update
+    static std::unique_ptr<BasicRenderPipeline> atlasProgram; //basicProgram, but for sprites in SpriteAtlas::atlas
+    static std::unique_ptr<BasicRenderPipeline> sprite9Program; //draws a whole Sprite9 panel per instance, see Sprite9::request
 
     static void init(int screenWidth, int screenHeight); //this init function initiates the basic renderprograms
 
+    //if true, SpriteManager::requestSprite and PolyRender throw out requests that are entirely off screen before they are recorded. Off by default,
+    //since a request's shader can put it anywhere and we only know about the rect we were given
+    static bool culling;
+    static glm::vec4 getWorldRect(float z = 0); //the part of the world that is visible at "z". In perspective mode, this is bigger the further away "z" is
+    static bool isVisible(const glm::vec4& rect, float z); //true if "rect" overlaps the view at "z"
+    static bool isVisible(const glm::vec4& rect, float z, float angle); //same, but "rect" is rotated "angle" radians around its center
+    static bool isVisible(const glm::vec2& center, float radius, float z); //true if the circle overlaps the view at "z"
+
     static glm::vec2 toAbsolute(const glm::vec2& point);//given a screen coordinate, renders it to that point on the screen regardless of zoom
     static glm::vec4 toAbsolute(const glm::vec4& rect);
 
@@ -257,21 +512,7 @@ private:
 template<size_t N>
 BasicRenderPipeline::BasicRenderPipeline(LoadShaderInfo (&&info)[N],const DivisorStorage& divisors_,const float* verts, int floatsPerVertex_, int vertexAmount_) : vertexAmount(vertexAmount_), divisors(divisors_)
 {
-
-    program = glCreateProgram();
-    ViewPort::linkUniformBuffer(program);
-
-
-    for (auto&& shaderInfo : info)
-    {
-        GLuint shader = loadShaders(std::move(shaderInfo),&numbers);
-        if (shader != -1)
-        {
-            glAttachShader(program,shader);
-            glDeleteShader(shader);
-        }
-    }
-    glLinkProgram(program);
+    initProgram(info,N);
 
     glGenVertexArrays(1,&VAO);
 
@@ -285,11 +526,10 @@ template <typename T,typename... Args>
 void BasicRenderPipeline::draw(GLenum mode, T t1, Args... args) //pass in a bunch of data and then draw
 {
     //maybe consider making this a separate function that takes in a BasicRenderPipeline and draws rather than calling it from the Pipeline itself
-    RenderPayload payload = packData(t1,args...);
-    bufferPayload(payload);
+    GLuint base = bufferPayload(packData(t1,args...));
 
-    glUseProgram(program);
-    glDrawArrays(mode,0,vertexAmount);
+    use();
+    drawInstanced(mode,1,base);
 }
 
 template <typename T,typename... Args>
@@ -311,9 +551,12 @@ void BasicRenderPipeline::packDataHelper(RenderPayload& payload, int divisorsInd
 
 
 template <typename T,typename... Args>
-RenderPayload BasicRenderPipeline::packData(T t1, Args... args)
+RenderPayload& BasicRenderPipeline::packData(T t1, Args... args)
 {
-    RenderPayload payload;
+    for (auto it = payload.begin(); it != payload.end(); ++it)
+    {
+        it->clear(); //keeps the capacity
+    }
     packDataHelper(payload,1,(divisors[1] == 0 ? 0 : vertexAmount - 1),t1,args...); //start at "divisorsIndex" 1 because verticies are processed separately
     return payload;
 }
@@ -353,28 +596,188 @@ enum RenderEffect
     HORIZMIRROR
 };
 
+enum AlphaClass
+{
+    ALPHA_OPAQUE, //every pixel has an alpha of 255
+    ALPHA_CUTOUT, //every pixel is either 0 or 255, so it can be drawn with the opaques by discarding the transparent fragments
+    ALPHA_TRANSLUSCENT //has partially transparent pixels, so it has to be sorted and blended
+};
+
+struct AlphaInfo
+{
+    AlphaClass type = ALPHA_OPAQUE;
+    glm::ivec4 bounds = glm::ivec4(0); //smallest rect (x, y, width, height in pixels) with every pixel that isn't fully transparent. All 0 if there are none
+};
+
+AlphaInfo classifyAlpha(const unsigned char* rgba, int width, int height); //scans an RGBA image. Uses AVX2 or SSE2 if we were compiled with them
 bool isTransluscent(unsigned char* sprite, int width, int height); //returns true if sprite has any pixels with an alpha value that is not 1
 
+struct TextureCache
+{
+    /*caches decoded images on disk, so we don't have to decode pngs and generate mipmaps every launch. Each cache file has a header, then every mipmap
+    level's pixels one after another, and is memory mapped when loaded so we can upload straight out of it. The header has the size and modified time of
+    the image it came from, so editing the image misses the cache. Only on if the "texture_cache_dir" config variable is set. Sprite::load writes
+    the cache file whenever it misses, or call bake to do it ahead of time*/
+    struct Image
+    {
+        int width = 0, height = 0, channels = 0;
+        AlphaInfo alpha;
+        std::vector<const unsigned char*> levels; //pixels of each mipmap level, 0 being full size. Points into "file", so only valid while the Image is
+        MappedFile file;
+    };
+    static bool isEnabled();
+    static bool load(const std::string& source, int desiredChannels, Image& image); //"desiredChannels" is what we would pass to stbi_load. Returns false if there's no up to date cache file
+    static void save(const std::string& source, int desiredChannels, const unsigned char* pixels, int width, int height, int channels, const AlphaInfo& alpha);
+    static bool bake(const std::string& source, bool atlased = false); //decodes "source" and saves it. Returns false if the image couldn't be decoded
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint32_t width, height, channels, levels;
+        uint32_t alphaClass;
+        int32_t bounds[4];
+        uint32_t padding;
+    };
+    static constexpr uint32_t VERSION = 2;
+    static std::string getPath(const std::string& source, int desiredChannels);
+    static bool getSourceInfo(const std::string& source, uint64_t& size, int64_t& time);
+    static std::vector<unsigned char> halve(const unsigned char* pixels, int width, int height, int channels); //box filters "pixels" into the next mipmap level
+};
+
+class SpriteAtlas
+{
+    /*packs sprites into the layers of one GL_TEXTURE_2D_ARRAY. Every sprite in the atlas shares a texture, so sprites with different images but the
+    same pipeline can be drawn in one batch. Each layer is shelf packed: sprites are placed left to right in rows ("shelves") that are as tall as the
+    first sprite put in them. Sprites are padded with copies of their edge pixels so linear filtering doesn't bleed in neighbors.
+    To draw atlased sprites, use a pipeline that has been setAtlased, such as ViewPort::atlasProgram*/
+public:
+    static SpriteAtlas atlas; //the atlas sprites are loaded into by default
+    static constexpr int PADDING = 4; //pixels of padding around each sprite. Also limits how many mipmap levels we can use before bleeding
+    void init(int pageSize_ = 2048, int layers_ = 4); //allocates the texture array. Called automatically the first time a sprite is added
+    bool add(unsigned char* data, int w, int h, int& layer, glm::vec4& rect); //adds RGBA pixel data. Returns false if there is no room left, otherwise sets "layer" and "rect" (normalized uvs)
+    bool reserve(int w, int h, int& layer, glm::vec4& rect, glm::ivec2& corner); //like add, but only claims the room. "corner" is where the padded image goes, see upload
+    void upload(const void* padded, int layer, const glm::ivec2& corner, int w, int h); //uploads padded RGBA rows to "corner" in "layer". "padded" can be an offset into a bound GL_PIXEL_UNPACK_BUFFER
+    static std::vector<unsigned char> pad(const unsigned char* data, int w, int h); //returns a copy of RGBA "data" with PADDING copies of the edge pixels on every side
+    void getPlaceholder(int& layer, glm::vec4& rect); //where SpriteLoader's placeholder pixel is in the atlas
+    void update(); //regenerates mipmaps if anything was added since the last update. SpriteManager::render calls this
+    unsigned int getTexture() const;
+private:
+    struct Shelf
+    {
+        int layer = 0;
+        int y = 0; //top of the shelf
+        int height = 0;
+        int x = 0; //how much of the shelf has been used
+    };
+    std::vector<Shelf> shelves;
+    std::vector<int> layerHeights; //how much of each layer has been claimed by shelves
+    unsigned int texture = 0;
+    int pageSize = 0;
+    int layers = 0;
+    bool dirty = false; //true if we have to regenerate mipmaps
+    int placeholderLayer = -1;
+    glm::vec4 placeholderRect;
+};
+
 class Sprite
 {
+    friend class SpriteLoader;
+public:
+    enum LoadState
+    {
+        UNLOADED,
+        LOADING, //being loaded by SpriteLoader, renders as a placeholder until it's done
+        LOADED,
+        FAILED
+    };
 protected:
+    LoadState state = UNLOADED;
     int width = 0, height = 0;
     unsigned int texture = 0;
-    bool transluscent = false; //returns true if sprite has any pixels with an alpha value that is not 1
+    AlphaInfo alpha; //ALPHA_OPAQUE and ALPHA_CUTOUT sprites are drawn with the opaques, see SpriteManager
+    int layer = -1; //layer in SpriteAtlas::atlas. -1 if this sprite has its own texture
+    glm::vec4 atlasRect = {0,0,1,1}; //where in the atlas layer this sprite is, normalized
 public:
-    void load(std::string source);
+    void load(std::string source, bool atlased = false); //if atlased is true, try to put the sprite in SpriteAtlas::atlas. Falls back to its own texture if the atlas is full
+    void loadAsync(std::string source, bool atlased = false); //load, but in the background. See SpriteLoader. Don't copy the sprite until it's done loading, the copy won't get the texture
     std::string source = "";
-    Sprite(std::string source);
+    Sprite(std::string source, bool atlased = false);
     Sprite()
     {
         texture = 0;
     }
     ~Sprite();
-    unsigned int getTexture() const;
+    unsigned int getTexture() const; //for atlased sprites, this is the atlas' texture
+    GLenum getTarget() const; //GL_TEXTURE_2D_ARRAY for atlased sprites, GL_TEXTURE_2D otherwise
+    int getLayer() const;
+    const glm::vec4& getAtlasRect() const;
+    bool isAtlased() const;
     std::string getSource() const;
-    bool getTransluscent() const;
-    void init(std::string source);
-    virtual glm::vec2 getDimen() const;
+    bool getTransluscent() const; //true if the sprite has partially transparent pixels, which means it has to be sorted. Cutouts aren't transluscent
+    AlphaClass getAlphaClass() const;
+    const glm::ivec4& getOpaqueBounds() const; //the part of the sprite that isn't fully transparent, in pixels
+    LoadState getLoadState() const;
+    void init(std::string source, bool atlased = false);
+    virtual glm::vec2 getDimen() const; //for sprites that are still loading, this is already correct
+};
+
+class SpriteLoader
+{
+    /*loads sprites without freezing the game. Decoding the image and checking it for transluscent pixels happen on a pool of worker threads, then
+    the pixels are uploaded through a pixel buffer object at most uploadBudget bytes per frame, a few rows at a time. Until then the sprite is drawn
+    with a grey placeholder. Everything other than the workers runs on the thread with the OpenGL context*/
+public:
+    static size_t uploadBudget; //max bytes uploaded per update
+    static void init(unsigned int threads = 0); //starts the worker threads. 0 means one less than the number of cores. Called by the first load
+    static void load(Sprite& sprite, const std::string& source, bool atlased); //Sprite::loadAsync calls this
+    static void cancel(Sprite& sprite); //stops loading "sprite", leaving it as a placeholder. Sprite's destructor calls this
+    static void update(); //uploads whatever has been decoded, up to uploadBudget bytes. SpriteManager::render calls this every frame
+    static void wait(const std::vector<Sprite*>& sprites); //blocks until all "sprites" are done loading, uploading them as fast as possible
+    static void waitAll();
+    static size_t getPending(); //number of sprites still loading
+    static void shutdown(); //stops the worker threads. Called automatically at exit
+private:
+    struct Job //a sprite we have to decode
+    {
+        Sprite* sprite = nullptr;
+        unsigned int id = 0; //so we can tell if the sprite was cancelled and loaded again
+        std::string source = "";
+        bool atlased = false;
+    };
+    struct Upload //a decoded sprite we are uploading
+    {
+        Job job;
+        std::vector<unsigned char> pixels; //already padded if job.atlased. Empty if decoding failed
+        int width = 0, height = 0, channels = 0;
+        AlphaInfo alpha;
+
+        bool started = false;
+        int rows = 0; //rows uploaded so far
+        unsigned int texture = 0;
+        int layer = -1;
+        glm::vec4 atlasRect = {0,0,1,1};
+        glm::ivec2 corner;
+    };
+    static std::vector<std::thread> workers;
+    static std::deque<Job> jobs;
+    static std::vector<Upload> decoded; //finished by workers, waiting to be picked up by update
+    static std::deque<Upload> uploads;
+    static std::unordered_map<Sprite*,unsigned int> loading; //sprites that are loading and the id of their current job
+    static std::mutex mutex; //for all of the above other than uploads, which only the OpenGL thread touches
+    static std::condition_variable jobAdded, jobDecoded;
+    static bool stopping;
+    static unsigned int nextID;
+    static unsigned int placeholder; //1x1 texture for non-atlased sprites that are still loading
+    static Buffer PBO;
+
+    static void work(); //what each worker thread runs
+    static size_t upload(size_t budget); //uploads up to "budget" bytes, returns how many were uploaded
+    static size_t uploadSlice(Upload& upload, size_t budget);
+    static void finish(Upload& upload);
+    static bool isLoading(Sprite* sprite, unsigned int id);
 };
 
 class Sprite9 : public Sprite // This sprite has been split into 9 sections that each scale differently. The corners aren't scaled at all, the top and bottom
@@ -390,6 +793,19 @@ public:
     }
     int getFloats();
     void init(std::string source, glm::vec2 W, glm::vec2 H);
+    /**
+      *   \brief Requests the whole panel as one instance; sprite9Vertex splits it into the 9 regions. The pipeline's inputs after the 54 verticies
+      *   must be rect, z, radians, tint, and then the borders (widths then heights)
+      *
+      *   \param rect: where to draw the panel. If it's smaller than the borders, the borders shrink to fit
+      *   \param z: the z to draw at
+      *   \param radians: rotation around the center of the panel
+      *   \param tint: multiplied with the sprite. Panels are always sorted with the transluscents, since a tint can fade even an opaque sprite
+      *
+      *   \return nothing
+      **/
+    void request(const glm::vec4& rect, ZType z, float radians = 0, const glm::vec4& tint = glm::vec4(1), BasicRenderPipeline& pipeline = *ViewPort::sprite9Program);
+    static const float* getVerticies(); //the 54 verticies of sprite9Vertex, 4 floats each: the corner of the quad and the column and row of its region
 
 };
 
@@ -425,7 +841,8 @@ struct RenderRequest //bare bones info for each request: what sprite is being re
 
     bool operator==( const RenderRequest& r2) const
     {
-        return &program == &r2.program && sprite == r2.sprite && mode == r2.mode;
+        //compare textures rather than sprites, sprites in the same atlas can be drawn together
+        return &program == &r2.program && (sprite ? sprite->getTexture() : 0) == (r2.sprite ? r2.sprite->getTexture() : 0) && mode == r2.mode;
     }
 
     bool operator<(const RenderRequest& b) const
@@ -438,51 +855,97 @@ struct RenderRequest //bare bones info for each request: what sprite is being re
     }
 };
 
-struct TransManager //handles transluscent fragment render requests.
+struct TransManager //handles transluscent fragment render requests. Also used for opaque requests, see "opaque"
 {
      //Transluscents must be rendered after opaques and sorted by distance from the screen from furthest
      //(smallest z) to closest (largest z) to prevent fragments from being discarded via the depth test
-    struct TransRequest //each request must be sorted the z value (for sorting) and we need to know the index in "data" where the transformations are stored
+     //Opaques don't care about order since the depth test sorts them out for us, so they are only sorted into batches and then front to back within each batch
+    struct TransRequest //we need to know the index in "data" where the transformations are stored
     {
         RenderRequest request;
         ZType z;
-        int index;
-        bool operator<(const TransRequest& b) const
-        {
-            return (z < b.z);
-        }
+        size_t index;
+        unsigned int order; //see SpriteManager::setRecordOrder
     };
+    struct SortKey //what we actually sort. Sorting these rather than the requests themselves keeps the sort to moving 16 bytes around per request
+    {
+        uint64_t key; //see getSortKey
+        unsigned int request; //index of the request in "requests"
+    };
+    TransManager(bool opaque_ = false);
+    /**
+      *   \brief Packs everything we sort by into one number. For transluscents, from most to least significant: z (32 bits), program id (12 bits), the sprite's texture (16 bits), and the primitive (4 bits)
+      *   For opaques, z goes last and is flipped so we render front to back. Ids that don't fit are truncated, which at worst splits up a batch;
+      *   we still compare the actual RenderRequests to decide where batches end.
+      *
+      *   \param request: the request
+      *   \param z: the z that this request will be rendered at
+      *
+      *   \return the key
+      **/
+    uint64_t getSortKey(const RenderRequest& request, ZType z) const;
     /**
       *   \brief Creates the request
       *
       *   \param request: the actual request
       *   \param z: the z that this request will be rendered at
+      *   \param order: breaks ties between requests with the same sort key, smallest first. Requests with the same order stay in the order they were requested
       *
       *   \return nothing
       **/
-    void request(const RenderRequest& request, ZType z);
+    void request(const RenderRequest& request, ZType z, unsigned int order = 0);
     void render();
+    void absorb(TransManager& other); //moves all of "other"'s requests into this manager, after our own
+    bool isOpaque() const;
     std::vector<char> data; //buffer used to store all vertex attributes. Unsorted.
 private:
+    bool opaque = false; //if true, requests are sorted for the depth test rather than the painter's algorithm
+    bool inOrder = true; //true if "requests" is already sorted by order, in which case render doesn't have to sort by it
     /**
-      *   \brief Renders every transluscent request, attempting to render all sprites/program pairs in one go for efficiency
+      *   \brief Renders one batch: every request from "keys[begin]" to "keys[end]", all of which must have the same RenderRequest.
+      *   For pipelines with draw ids, they only need the same pipeline and mode, and their textures have to be in batchTextures
       *
-      *   \param request: the actual request itself
-      *   \param bytes: a pointer to the point in memory where all the data for this rendering is
-      *   \param size: how many bytes we are sending
+      *   \param begin: index into "keys" of the first request in the batch
+      *   \param end: index into "keys" right after the last request in the batch
       *
       *   \return nothing
       **/
-    void render(const RenderRequest& request, RenderPayload& payload, int instances); //renders all data in payload
+    void render(size_t begin, size_t end);
+    std::vector<GLuint> batchTextures; //if the batch being rendered uses draw ids, every texture in it. The i-th one is bound to texture unit i
 
-    RenderPayload buffer; //reusable buffer for sorting data. Used to compile all data one sprite-renderprogram pairing.
-    std::list<TransRequest> requests; //unsorted list of requests, sorted before we render
+    std::vector<TransRequest> requests; //requests in the order they were made. Never sorted, we sort "keys" instead
+    std::vector<SortKey> keys; //one for each request, radix sorted before we render. Requests with the same key stay in the order they were requested
+    std::vector<SortKey> scratch; //reused memory for the radix sort
 };
 
 class SpriteManager //handles all sprite requests
 {
+    struct RecordBuffer //where one thread records its requests until they are merged in render
+    {
+        TransManager trans;
+        TransManager opaques = TransManager(true);
+        CullStats cullStats;
+        unsigned int order = 0; //see setRecordOrder
+        bool tagged = false; //true if setRecordOrder was called this frame
+        bool inUse = true; //false once the thread that owned this buffer has exited, so another thread can take it
+    };
 public:
-    static TransManager trans;
+    static TransManager trans; //every thread's requests are merged into these two right before rendering
+    static TransManager opaques; //requests for sprites that aren't transluscent. Drawn first, front to back, with the depth test doing the sorting
+
+    /**
+      *   \brief Requests with the same z, pipeline, and sprite are rendered in the order they were requested, which is meaningless if they were requested
+      *   from different threads. To keep that order deterministic, tag each chunk of work (for example, the index of the partition of entities you are walking)
+      *   with an order; ties are rendered from smallest order to largest, and within an order in the order they were requested.
+      *   Each order should only be recorded by one thread per frame. Applies to the calling thread only, and resets to 0 every frame.
+      *   The output is only deterministic if every thread that records tags its work. Untagged requests from different threads tie on order 0 and are
+      *   broken by which thread first recorded, which depends on scheduling; render warns (once) if more than one thread recorded untagged requests
+      *
+      *   \param order: the order of every request this thread makes from now on
+      *
+      *   \return nothing
+      **/
+    static void setRecordOrder(unsigned int order);
     /**
       *   \brief Creates a rendering request, which will be rendered at the end of every game loop
       *
@@ -492,10 +955,20 @@ public:
       *   \return nothing
       **/
     template<typename... Args>
-    static void request(const RenderRequest& request, ZType z, Args... args) //request for non-sprites
+    static void request(const RenderRequest& request, ZType z, Args... args) //request for non-sprites. Safe to call from any thread, just not during render
     {
-        trans.request(request,z); //transluscent manager needs to make a request specifically for the sprite-program pairing
-        fillBytesVec(trans.data,request.program.getBytesPerRequest(),args...); //place request into transluscent manager
+        RecordBuffer& buffer = getBuffer();
+        //only sprites can be opaque, and only through pipelines that promise not to change their alpha. Cutouts need a pipeline that can discard their transparent parts
+        AlphaClass alpha = request.sprite && request.program.isOpaqueSafe() ? request.sprite->getAlphaClass() : ALPHA_TRANSLUSCENT;
+        bool opaque = alpha == ALPHA_OPAQUE || (alpha == ALPHA_CUTOUT && request.program.canDiscard());
+        TransManager& manager = opaque ? buffer.opaques : buffer.trans;
+        manager.request(request,z,buffer.order); //manager needs to make a request specifically for the sprite-program pairing
+        fillBytesVec(manager.data,request.program.getBytesPerRequest(),args...); //place request into the manager
+        if (request.sprite && request.program.isAtlased())
+        {
+            //atlas pipelines take where the sprite is in the atlas as their last two inputs
+            fillAtlasInfo(*request.sprite,&manager.data[manager.data.size() - sizeof(glm::vec4) - sizeof(float)]);
+        }
     }
 
     ///Non-sprite requests are automatically put in TransManager
@@ -503,56 +976,122 @@ public:
     template<typename... Args>
     static void requestSprite(const RenderRequest& request_, const glm::vec4& rect, ZType z, Args... args) //request for sprites
     {
+        if (ViewPort::culling)
+        {
+            //we don't know if the shader rotates the sprite, so assume it could be at any angle
+            CullStats& stats = getBuffer().cullStats;
+            if (!ViewPort::isVisible(glm::vec2(rect.x + rect.z/2,rect.y + rect.a/2),0.5f*sqrt(rect.z*rect.z + rect.a*rect.a),z))
+            {
+                stats.culled++;
+                return;
+            }
+            stats.kept++;
+        }
         //many sprite shaders have a rect as their 2nd parameter, so this just makes that easier to account for
         request(request_,z,rect,z,args...);
     }
 
+    static const CullStats& getCullStats(); //how many sprites were culled and kept last frame. Only counted while ViewPort::culling is on
+
 
     /**
-      *   \brief Renders all requests
+      *   \brief Renders all requests. Must be called from the thread with the OpenGL context, and no other thread can be making requests while it runs
       *
       *   \return nothing
       **/
     static void render();
+private:
+    static std::vector<std::unique_ptr<RecordBuffer>> buffers; //one for each thread that has made a request. Never shrinks, buffers of exited threads are reused
+    static std::mutex buffersMutex; //only locked the first time a thread makes a request
+    static CullStats cullStats; //last frame's, totaled from every buffer
+    static RecordBuffer& getBuffer(); //the calling thread's buffer
+    static void fillAtlasInfo(const Sprite& sprite, char* bytes); //writes the sprite's atlas rect and layer into "bytes"
 };
 
 template<typename T>
 using PolyStorage = std::vector<T>;
 struct PolyRender
 {
-    static std::vector<std::pair<glm::vec3,glm::vec4>> lines; //lines and their colors
-    static PolyStorage<glm::vec4> polyColors; //color of each polygon. Color is repeated once for each edge of the polygon
+    static std::vector<std::pair<glm::vec3,glm::vec4>> lines; //1 pixel lines and their colors, drawn as GL_LINES
+    static PolyStorage<GLuint> polyColors; //color of each point of each polygon, packed by packColor. Color is repeated once for each edge of the polygon
     static PolyStorage<glm::vec3> polyPoints; //points of polygons
-    static PolyStorage<GLuint> polyIndices;
+    static PolyStorage<GLushort> polyIndices; //indices into the current chunk's points (see PolyChunk), with a restart after each polygon
     static int polygonRequests; //number of requests for a polygon
     static std::unique_ptr<BasicRenderPipeline> polyRenderer;
+    static std::unique_ptr<BasicRenderPipeline> lineRenderer; //draws thick lines, one instance per line
+    static std::unique_ptr<BasicRenderPipeline> shapeRenderer; //draws circles and regular polygons, one instance per shape
+    static bool antialiasLines; //if true, lines requested from now on are drawn as quads that fade out over a pixel at their edges. Needs GL_BLEND
     static unsigned int VAO;
     static unsigned int lineVBO;
-    static unsigned int polyVBO;
-    static unsigned int colorVBO;
+    static Buffer polyVBOs[StreamBuffer::FRAMES]; //points followed by colors. One per StreamBuffer frame so we never overwrite what the GPU is still drawing
+    static Buffer polyEBOs[StreamBuffer::FRAMES];
+    static size_t polyVBOSizes[StreamBuffer::FRAMES]; //bytes allocated for each buffer, we only call glBufferData when a frame needs more than this
+    static size_t polyEBOSizes[StreamBuffer::FRAMES];
     static void init(int screenWidth, int screenHeight);
     static void requestLine(const glm::vec4& line, const glm::vec4& color, float z = 0, unsigned int thickness = 1);
     static void requestGradientLine(const glm::vec4& line, const glm::vec4& color1, const glm::vec4& color2, float z = 0, unsigned int thickness = 1);
     static void requestCircleSegment(float segHeight,float angle, const glm::vec4& color,const glm::vec2& center, double radius, bool filled, float z); //draw a CircleSegment. Angle = 0 means that only the top of the circle will be drawn.
     static void requestCircle(const glm::vec4& color,const glm::vec2& center, double radius, bool filled, float z);
+    /**
+      *   \brief Draws a circle or regular polygon as one instance, cut out of a square by shapeFragment. Edges are antialiased
+      *
+      *   \param sides: less than 3 for a circle
+      *   \param radius: distance from the center to the edge of a circle, or to a corner of a polygon
+      *   \param angle: rotation in radians. With no rotation, polygons have an edge at the bottom
+      *   \param thickness: 0 for a filled shape, otherwise how thick the outline is. Outlines are centered on the edge
+      *   \param arc: how much of the shape to draw in radians, starting at "angle". Anything 2pi or more draws all of it
+      *
+      *   \return nothing
+      **/
+    static void requestShape(const glm::vec2& center, float radius, int sides, const glm::vec4& color, float angle, float thickness, float z, float arc = 6.28318531f); //2pi
+    static void requestRing(const glm::vec2& center, float radius, float thickness, const glm::vec4& color, float z); //circle outline
+    static void requestArc(const glm::vec2& center, float radius, float start, float arc, float thickness, const glm::vec4& color, float z); //part of a ring, from "start" to "start + arc" radians. Thickness 0 draws a pie slice
     static void requestRect(const glm::vec4& rect, const glm::vec4& color, bool filled, double angle, float z);
     static void requestNGon(int n, const glm::vec2& center, double side, const glm::vec4& color, double angle, bool filled, float z, bool radius = false); //draws a regular n gon. Angle is in radians. If radius is true, then side is the radius length rather than the side length
     static void requestPolygon(const std::vector<glm::vec3>& points, const glm::vec4& color);
+    static const CullStats& getCullStats(); //how many shapes were culled and kept last frame. Only counted while ViewPort::culling is on
     static void render();
     static void renderMesh(float* mesh, int w, int h);
-    static void renderLines(); //renders lines. Can be called from other functions to render all lines currently requested
+    static void renderLines(); //renders lines, thick and thin. Can be called from other functions to render all lines currently requested
     static void renderPolygons();
+    static void renderShapes();
 private:
-    static int getIndiciesNumber() //number of indicies minus restarts
-    {
-        return polyIndices.size() - polygonRequests;
-    }
-    static void addPointAndIndex(const glm::vec3& point) //adds a point to polyPoints as well as the index based on how many indicies have already been added
+    struct PolyChunk //a run of polygons whose indices fit in a GLushort. Each chunk is drawn with glDrawElementsBaseVertex so its indices can start at 0
     {
-        polyPoints.push_back(point);
-        polyIndices.push_back(getIndiciesNumber());
-    }
+        GLint firstPoint = 0;
+        size_t firstIndex = 0;
+    };
+    static std::vector<PolyChunk> polyChunks;
+    static GLushort beginPolygon(int points); //returns the index the polygon's first point will have, starting a new chunk if "points" more won't fit in this one
+    static GLuint packColor(const glm::vec4& color); //normalized RGBA8, red in the lowest byte
     static unsigned short restart; //restart indice
+    static CullStats cullStats; //this frame's
+    static CullStats lastCullStats; //last frame's
+    static bool cull(const glm::vec4& rect, float z, float angle = 0); //updates cullStats, returns true if the request should be thrown out
+    static void addLine(const glm::vec4& line, const glm::vec4& color1, const glm::vec4& color2, float z, unsigned int thickness); //requestGradientLine without the culling, for shapes made of lines
+
+    struct WideLine //one lineRenderer instance, laid out exactly like its vertex inputs
+    {
+        glm::vec4 line;
+        glm::vec4 color1, color2;
+        float thickness = 1;
+        float z = 0;
+        float antialias = 0;
+    };
+    static std::vector<WideLine> wideLines; //lines that are thicker than a pixel or antialiased. Never shrinks, so requesting lines doesn't allocate
+
+    struct Shape //one shapeRenderer instance, laid out exactly like its vertex inputs
+    {
+        glm::vec2 center;
+        float radius = 0;
+        float sides = 0;
+        float angle = 0;
+        float thickness = 0;
+        float arc = 6.28318531f; //2pi, the whole shape
+        float z = 0;
+        glm::vec4 color;
+    };
+    static std::vector<Shape> shapes;
 };
 
 
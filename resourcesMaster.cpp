@@ -2,6 +2,8 @@
 #include "vanilla.h"
 
 std::string ResourcesConfig::RESOURCES_DIR = "resources_dir";
+std::string ResourcesConfig::PROGRAM_CACHE_DIR = "program_cache_dir";
+std::string ResourcesConfig::TEXTURE_CACHE_DIR = "texture_cache_dir";
 
 std::unordered_map<std::string,std::string> ResourcesConfig::config;
 
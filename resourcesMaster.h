@@ -7,6 +7,8 @@
 struct ResourcesConfig
 {
     static std::string RESOURCES_DIR; //the config variable name that denotes where our resources folder is
+    static std::string PROGRAM_CACHE_DIR; //the config variable name for where to cache compiled shader programs. If not set, programs aren't cached
+    static std::string TEXTURE_CACHE_DIR; //the config variable name for where to cache decoded textures. If not set, textures aren't cached
     static std::unordered_map<std::string,std::string> config; //a set of configuration variables
     static void loadConfig(); //loads config file variables
 
@@ -0,0 +1,306 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <regex>
+#include <cmath>
+#include <filesystem>
+
+#include "render.h"
+#include "resourcesMaster.h"
+
+/*Checks that the hand written shader scanners in render.cpp (stripComments, getVertexInputs, templateShader and preprocessShader) give the same output
+as the regex versions they replaced, on every file in shaders/. The regex versions are kept here, exactly as they were, so there's something to compare to.
+Run from anywhere with the path to the Resources folder as the only argument (defaults to ".."). Prints every mismatch and returns 1 if there were any.*/
+
+namespace regexVersion
+{
+//the old vanilla.h helpers, only used by the regex versions below
+template<typename Lambda>
+void regexSearch(std::string reg, std::string str, Lambda lambda)
+{
+    //given a string and a regex, parses the string using the regex, and runs "lambda" on each match
+    //lambda: (const std::smatch& -> void)
+    std::regex rgx(reg);
+    std::smatch match;
+    while (std::regex_search (str,match,rgx)) {
+        lambda(match);
+        str = match.suffix().str();
+   }
+}
+
+template<typename Lambda>
+std::string regexReplace(const std::regex rgx, std::string str, Lambda lambda)
+{
+    std::smatch match;
+    if (std::regex_search(str,match,rgx))
+    {
+        return match.prefix().str() + lambda(str,match) + regexReplace(rgx,match.suffix().str(),lambda);
+    }
+    return str;
+}
+
+std::string stripComments(const std::string& shaderContents)
+{
+    return std::regex_replace (shaderContents,std::regex("\\/\\/.+\\n"),"\n");
+}
+
+std::string glslTypesCaptureGroup = "(bool|int|float|vec([2-4])|mat([2-4]))"; //regex for capturing glsl types
+std::string findVertexInputsRgx = "layout \\(location = ([0-9]+)\\) in " + glslTypesCaptureGroup +" .+;\\s*"; //regex for vertex shader inputs
+Numbers getVertexInputs(const std::string& vertexFile)
+{
+    Numbers numbers;
+    regexSearch(findVertexInputsRgx,vertexFile,[&numbers](std::smatch& it){
+    std::string type = it[2];
+    if (type == "bool" || type == "int" || type == "float")
+    {
+        numbers.push_back(1);
+    }
+    else if (type.substr(0,3) == "vec")
+    {
+        numbers.push_back(std::stoi((it)[3]));
+    }
+    else if (type.substr(0,3) == "mat")
+    {
+        numbers.push_back(pow(std::stoi((it)[3]),2));
+    }
+    }); //replace environment variables
+    return numbers;
+}
+
+
+std::pair<std::string,bool> preprocessShader(const LoadShaderInfo& info)
+{
+    const std::string* source = nullptr;
+    std::pair<std::string, bool> result;
+    //std::cout << info.isFilePath << " " << info.code << "\n";
+    if (info.isFilePath)
+    {
+        result = readFile(info.code);
+
+        if (result.second)
+        {
+            source = &result.first;
+        }
+        else
+        {
+            std::cerr << "Can't find shader! Source: " << info.code << std::endl;
+            return {"",false};
+        }
+    }
+    else
+    {
+        source = &info.code;
+    }
+
+    //strip comments, makes processing easier
+    std::string strippedCode = stripComments(*source);
+    std::string* shaderCode = &strippedCode;
+
+    //lambda to replace environment variables.
+    auto lambda = [](std::string&, const std::smatch& it){
+                std::string varName = (it)[1];
+                if (ResourcesConfig::config.find(varName) != ResourcesConfig::config.end())
+                {
+                    //std::cout << varName << " " << ResourcesConfig::config[varName] << "\n";
+                    return ResourcesConfig::config[varName];
+                    //std::cout << "ASDF: " << it[0] << " " << it.position(0)<< "\n";
+                }
+                return std::string(it[0]);
+                };
+
+    //replace environment variables
+    std::string varDefRegex = "\\$\\{(.*)\\}"; //regex for finding variables ${variable_name}
+    std::regex reg = std::regex(varDefRegex);
+    *shaderCode = regexReplace(reg,*shaderCode,lambda);
+
+
+    //import include files
+    std::ifstream openIncludeFile;
+    *shaderCode = regexReplace(std::regex("#include \"((.+/)*[^/]+)\"\\n"),*shaderCode,[&openIncludeFile,&shaderCode,&info](std::string,std::smatch& it){
+                std::string fileName = it[1];//(*it)[2];
+                openIncludeFile.open(fileName);
+                if (openIncludeFile.is_open())
+                {
+                    std::stringstream stream;
+                    stream << openIncludeFile.rdbuf();
+                    openIncludeFile.close();
+                    return stream.str();
+                }
+                else
+                {
+                    openIncludeFile.close();
+                    std::cerr << "Error loading shader " << (info.isFilePath ? info.code : "Unknown Shader") << ": Failed to find open include file " << fileName << std::endl;
+                    throw std::logic_error("Error loading shader");
+                    return std::string();
+
+                }
+                });
+    //replace environment variables inside include files
+    *shaderCode = regexReplace(reg,*shaderCode,lambda);
+
+    return {*shaderCode,true};
+}
+std::string templateShader(const std::string& shaderContents,
+                           bool isVertex, //whether or not the shader is a vertex shader, determines the syntax of the inputs
+                           std::initializer_list<std::string> inputs,
+                           std::initializer_list<std::string> outputs,
+                           std::initializer_list<std::string> tasks)
+{
+    //each iterator list has to have the type and name of the variable (e.g. "vec2 pos")
+
+    //it is assumed that all inputs in a file will be grouped together as will all outputs. This is not a huge deal except for vertex shaders, where this
+    //function has to find the largest layout number. For simplicity, it is assumed that all the layouts are in the same group of lines, right after one another
+    //and the there are no "holes" in the layouts, meaning if the largest layout number is 10, numbers 0-10 are all used. It is also expected that the layouts
+    //are organized in numerical order, so that the last layout input has the largest index. If you're not organizing your code like this already you should
+    //probably be put down. Finally, comments break this function. Please call stripComments first
+    std::string findLastInputRegex = isVertex ? "(" + findVertexInputsRgx + ")+" : //finds all the existing vertex inputs
+                                     "(in " + glslTypesCaptureGroup + " .+\\n)+";
+
+    std::string finalShader = "";
+    //handle inputs
+    regexSearch(findLastInputRegex,shaderContents,[&shaderContents,&finalShader,&inputs,isVertex](const std::smatch& it)
+                {
+                    int layout = 0; //largest layout parameter, only used for vertex shaders
+
+
+                    if (isVertex) //find the largest layout parameter
+                    {
+                        layout = std::stoi((it)[2]); //the 2nd capture group is the last number in the regex. Not sure how this works exactly but it seems to
+                    }
+
+                    int i = 1;
+                    for (auto input : inputs)
+                    {
+                        if (isVertex)
+                        {
+                            finalShader += "layout (location = " + std::to_string(layout + i) + ") ";
+                        }
+                        else if (input[0] == 'i' && input[1] == 'n' && input[2] == 't') //if our input is an int
+                        {
+                            finalShader += "flat ";//add "flat" keyword
+                        }
+                        finalShader += "in " + input + ";\n";
+                        i++;
+                    }
+                    finalShader = shaderContents.substr(0, it.position(0) + it.length()) + finalShader + shaderContents.substr(it.position(0) + it.length(), shaderContents.size());
+                });
+
+    //handle outputs now
+    regexSearch("(out " + glslTypesCaptureGroup + " .+\\n)+", finalShader,[&finalShader,&outputs](std::smatch& it){
+                    std::string newOutputs = "";
+                    for (auto output : outputs)
+                    {
+                        if (output[0] == 'i' && output[1] == 'n' && output[2] == 't') //if our input is an int
+                        {
+                            newOutputs += "flat ";//add "flat" keyword
+                        }
+                        newOutputs += "out " + output + ";\n";
+                    }
+                    finalShader = finalShader.substr(0, it.position(0) + it.length()) + newOutputs + finalShader.substr(it.position(0) + it.length(), finalShader.size());
+                } );
+
+    //modify the main function
+     regexSearch("void main\\(\\)\\s*\\{([\\s\\S]*)\\}", finalShader,[&finalShader,&tasks](std::smatch& it){
+                    std::string newTasks = "";
+                    for (auto task : tasks)
+                    {
+                        newTasks += task + ";\n"; //no need to provide semicolons, we provide them for you!
+                    }
+                    finalShader = finalShader.substr(0, it.position(1) + it.length(1)) + "\n" + newTasks + finalShader.substr(it.position(1) + it.length(1), finalShader.size());
+                } );
+    return finalShader;
+}
+}
+
+int mismatches = 0, checks = 0;
+
+void compare(const std::string& what, const std::string& expected, const std::string& actual)
+{
+    checks++;
+    if (expected != actual)
+    {
+        mismatches++;
+        std::cout << "MISMATCH: " << what << "\n--regex--\n" << expected << "\n--scanner--\n" << actual << "\n";
+    }
+}
+
+std::string toString(const Numbers& numbers)
+{
+    std::string answer;
+    for (int number : numbers)
+    {
+        answer += std::to_string(number) + ",";
+    }
+    return answer;
+}
+
+//the regex templateShader spliced multi-group shaders at a garbage position, so there's nothing to compare those against. None of ours have more than one
+bool hasOneGroup(const std::string& code, bool isVertex)
+{
+    int inputs = 0, outputs = 0;
+    regexVersion::regexSearch(isVertex ? "(" + regexVersion::findVertexInputsRgx + ")+" : "(in " + regexVersion::glslTypesCaptureGroup + " .+\\n)+",code,[&inputs](const std::smatch&){inputs++;});
+    regexVersion::regexSearch("(out " + regexVersion::glslTypesCaptureGroup + " .+\\n)+",code,[&outputs](const std::smatch&){outputs++;});
+    return inputs <= 1 && outputs <= 1;
+}
+
+void checkShader(const std::string& path)
+{
+    std::string code = readFile(path).first;
+    compare(path + " stripComments",regexVersion::stripComments(code),stripComments(code));
+
+    std::string stripped = stripComments(code);
+    try
+    {
+        compare(path + " getVertexInputs",toString(regexVersion::getVertexInputs(stripped)),toString(getVertexInputs(stripped)));
+    }
+    catch (std::invalid_argument&)
+    {
+        //the regex version called stoi on an empty capture group for mat inputs. The scanner counts them as n*n floats instead
+    }
+
+    for (bool isVertex : {true,false})
+    {
+        if (!hasOneGroup(stripped,isVertex))
+        {
+            continue;
+        }
+        std::string kind = isVertex ? " templateShader (vertex)" : " templateShader (fragment)";
+        //the same templates ViewPort uses, plus one with an int to check "flat"
+        compare(path + kind,regexVersion::templateShader(stripped,isVertex,{"vec4 atlasRect","float atlasLayer"},{"float layer"},{"texCoord = atlasRect.xy + texCoord*atlasRect.zw","layer = atlasLayer"}),
+                             templateShader(stripped,isVertex,{"vec4 atlasRect","float atlasLayer"},{"float layer"},{"texCoord = atlasRect.xy + texCoord*atlasRect.zw","layer = atlasLayer"}));
+        compare(path + kind,regexVersion::templateShader(stripped,isVertex,{"float drawID"},{"int spriteSlot"},{"spriteSlot = int(drawID)"}),
+                             templateShader(stripped,isVertex,{"float drawID"},{"int spriteSlot"},{"spriteSlot = int(drawID)"}));
+    }
+
+    LoadShaderInfo info;
+    info.code = path;
+    compare(path + " preprocessShader",regexVersion::preprocessShader(info).first,preprocessShader(info).first);
+}
+
+int main(int argc, char* argv[])
+{
+    std::string resources = argc > 1 ? argv[1] : "..";
+    ResourcesConfig::config[ResourcesConfig::RESOURCES_DIR] = resources; //so ${resources_dir} includes can be found
+
+    std::vector<std::string> shaders;
+    std::error_code error;
+    for (auto& entry : std::filesystem::recursive_directory_iterator(resources + "/shaders",error))
+    {
+        if (entry.is_regular_file())
+        {
+            shaders.push_back(entry.path().string());
+        }
+    }
+    if (error || shaders.size() == 0)
+    {
+        std::cerr << "No shaders found in " << resources << "/shaders" << std::endl;
+        return 1;
+    }
+    std::sort(shaders.begin(),shaders.end());
+    for (const std::string& path : shaders)
+    {
+        checkShader(path);
+    }
+    std::cout << shaders.size() << " shaders, " << checks << " checks, " << mismatches << " mismatches" << std::endl;
+    return mismatches > 0;
+}
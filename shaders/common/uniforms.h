@@ -7,5 +7,6 @@ layout (std140) uniform Matrices
     mat4 view;
     vec2 screenDimen;
     float cameraZ;
+    uint time; //SDL_GetTicks when ViewPort::update was last called
 
 };
@@ -0,0 +1,16 @@
+#version 330 core
+ //fragmentShader, but for sprites in a texture atlas
+out vec4 fragColor;
+in vec2 texCoord;
+in float layer;
+uniform sampler2DArray sprite;
+uniform float discardBelow; //set for opaques, so the transparent parts of cutout sprites don't write depth
+
+void main()
+{
+    fragColor = texture(sprite,vec3(texCoord,layer));
+    if (fragColor.a < discardBelow)
+    {
+        discard;
+    }
+}
@@ -3,10 +3,15 @@
 out vec4 fragColor;
 in vec2 texCoord;
 uniform sampler2D sprite;
+uniform float discardBelow; //set for opaques, so the transparent parts of cutout sprites don't write depth
 
 void main()
 {
     vec4 text = texture(sprite,texCoord);
+    if (text.a < discardBelow)
+    {
+        discard;
+    }
     fragColor = text;//vec4(1,0,0,1);
 
 }
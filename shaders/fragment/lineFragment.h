@@ -0,0 +1,16 @@
+#version 330 core
+//goes with lineVertex
+
+out vec4 FragColor;
+
+in vec4 shade;
+in float across;
+flat in float halfWidth;
+flat in float smoothEdges;
+
+void main()
+{
+    //how much of this pixel the line covers, assuming the line edge cuts straight through it
+    float coverage = smoothEdges > 0 ? clamp(halfWidth + 0.5 - abs(across),0.0,1.0) : 1.0;
+    FragColor = vec4(shade.rgb,shade.a*coverage);
+}
@@ -0,0 +1,50 @@
+#version 330 core
+//goes with shapeVertex. Works out how far each fragment is from the edge of the shape (negative is inside) and fades out over a pixel
+
+out vec4 FragColor;
+
+in vec2 local;
+flat in float shapeRadius;
+flat in float shapeSides;
+flat in float shapeThickness;
+flat in float shapeArc;
+in vec4 shade;
+
+const float PI = 3.14159265;
+
+void main()
+{
+    float dist;
+    if (shapeSides < 3)
+    {
+        dist = length(local) - shapeRadius;
+    }
+    else
+    {
+        //distance to the closest edge. With no rotation, there's an edge at the bottom (+y)
+        float halfSide = PI/shapeSides; //half the angle each edge takes up
+        float nearest = mod(atan(local.y,local.x) - PI/2 + halfSide,2*halfSide) - halfSide; //angle from the middle of the closest edge
+        dist = length(local)*cos(nearest) - shapeRadius*cos(halfSide);
+    }
+    if (shapeThickness > 0)
+    {
+        dist = abs(dist) - shapeThickness/2; //outlines are centered on the edge
+    }
+    if (shapeArc < 2*PI - 0.0001)
+    {
+        //cut out the wedge from 0 to shapeArc. Turn it so it's centered on +y, then it's Inigo Quilez's pie (https://iquilezles.org/articles/distfunctions2d/)
+        float halfArc = shapeArc/2;
+        float turn = PI/2 - halfArc;
+        vec2 p = vec2(local.x*cos(turn) - local.y*sin(turn),local.x*sin(turn) + local.y*cos(turn));
+        p.x = abs(p.x);
+        vec2 edge = vec2(sin(halfArc),cos(halfArc));
+        float wedge = length(p - edge*max(dot(p,edge),0.0))*sign(edge.y*p.x - edge.x*p.y);
+        dist = max(dist,wedge);
+    }
+    float coverage = clamp(0.5 - dist/max(fwidth(dist),0.0001),0.0,1.0);
+    if (coverage <= 0)
+    {
+        discard;
+    }
+    FragColor = vec4(shade.rgb,shade.a*coverage);
+}
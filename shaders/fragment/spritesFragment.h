@@ -0,0 +1,43 @@
+#version 330 core
+ //fragmentShader, but each instance can come from a different sprite. TransManager binds every sprite in a batch to its own texture unit
+out vec4 fragColor;
+in vec2 texCoord;
+flat in int spriteSlot; //which of "sprites" this instance's sprite is bound to
+uniform sampler2D sprites[8]; //BasicRenderPipeline::DRAW_TEXTURES
+uniform float discardBelow; //set for opaques, so the transparent parts of cutout sprites don't write depth
+
+vec4 sampleSprite(vec2 coord)
+{
+    //330 can only index sampler arrays with constants. Gradients are taken up here since only one branch runs, so mipmaps still pick the right level
+    vec2 dx = dFdx(coord);
+    vec2 dy = dFdy(coord);
+    switch (spriteSlot)
+    {
+    case 1:
+        return textureGrad(sprites[1],coord,dx,dy);
+    case 2:
+        return textureGrad(sprites[2],coord,dx,dy);
+    case 3:
+        return textureGrad(sprites[3],coord,dx,dy);
+    case 4:
+        return textureGrad(sprites[4],coord,dx,dy);
+    case 5:
+        return textureGrad(sprites[5],coord,dx,dy);
+    case 6:
+        return textureGrad(sprites[6],coord,dx,dy);
+    case 7:
+        return textureGrad(sprites[7],coord,dx,dy);
+    default:
+        return textureGrad(sprites[0],coord,dx,dy);
+    }
+}
+
+void main()
+{
+    vec4 text = sampleSprite(texCoord);
+    if (text.a < discardBelow)
+    {
+        discard;
+    }
+    fragColor = text;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+ //fragmentShader, but the sprite is multiplied by a color
+out vec4 fragColor;
+in vec2 texCoord;
+in vec4 tint;
+uniform sampler2D sprite;
+uniform float discardBelow; //set for opaques, so the transparent parts of cutout sprites don't write depth
+
+void main()
+{
+    fragColor = texture(sprite,texCoord)*tint;
+    if (fragColor.a < discardBelow)
+    {
+        discard;
+    }
+}
@@ -0,0 +1,37 @@
+#version 330 core
+//PolyRender's thick lines. Each instance is one line, stretched into a quad in here rather than drawn as a pile of 1 pixel lines
+
+layout (location = 0) in vec2 corner; //x goes along the line, -1 being the start and 1 the end. y goes across it
+layout (location = 1) in vec4 line; //start and end points
+layout (location = 2) in vec4 color1; //color at the start
+layout (location = 3) in vec4 color2; //color at the end
+layout (location = 4) in float thickness;
+layout (location = 5) in float z;
+layout (location = 6) in float antialias; //1 to fade the edges out over a pixel, 0 for hard edges
+
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+    mat4 view;
+};
+
+out vec4 shade;
+out float across; //distance from the middle of the line, in pixels
+flat out float halfWidth;
+flat out float smoothEdges;
+
+void main()
+{
+    vec2 dir = line.zw - line.xy;
+    float len = length(dir);
+    dir = len > 0 ? dir/len : vec2(1,0);
+    vec2 perp = vec2(-dir.y,dir.x);
+
+    float along = (corner.x + 1)/2.0;
+    halfWidth = thickness/2.0;
+    across = corner.y*(halfWidth + antialias); //antialiased lines get an extra pixel on each side to fade out in
+    smoothEdges = antialias;
+
+    gl_Position = projection*view*vec4(mix(line.xy,line.zw,along) + perp*across,z,1);
+    shade = mix(color1,color2,along);
+}
@@ -0,0 +1,40 @@
+#version 330 core
+//PolyRender's circles, rings, arcs, and regular polygons. Each instance is one shape, drawn as a square around it that shapeFragment cuts the shape out of
+
+layout (location = 0) in vec2 corner;
+layout (location = 1) in vec2 center;
+layout (location = 2) in float radius; //for polygons, the distance from the center to a corner
+layout (location = 3) in float sides; //less than 3 for circles
+layout (location = 4) in float angle; //rotation in radians. Arcs start here
+layout (location = 5) in float thickness; //0 for filled shapes, otherwise how thick the outline is
+layout (location = 6) in float arc; //how much of the shape to draw, in radians, going from "angle"
+layout (location = 7) in float z;
+layout (location = 8) in vec4 color;
+
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+    mat4 view;
+};
+
+out vec2 local; //position relative to the center, with the rotation undone
+flat out float shapeRadius;
+flat out float shapeSides;
+flat out float shapeThickness;
+flat out float shapeArc;
+out vec4 shade;
+
+void main()
+{
+    vec2 offset = corner*(radius + thickness/2 + 1); //an extra pixel to antialias into
+    gl_Position = projection*view*vec4(center + offset,z,1);
+
+    float c = cos(angle);
+    float s = sin(angle);
+    local = vec2(offset.x*c + offset.y*s,-offset.x*s + offset.y*c);
+    shapeRadius = radius;
+    shapeSides = sides;
+    shapeThickness = thickness;
+    shapeArc = arc;
+    shade = color;
+}
@@ -0,0 +1,43 @@
+#version 330 core
+//Sprite9 panels. Each instance is one panel and the 54 verticies are the quads of its 9 regions. Corners keep their size, the top and bottom only stretch
+//horizontally, the sides only stretch vertically, and the center stretches both ways
+
+layout (location = 0) in vec4 slice; //xy: corner of the quad, 0 to 1. zw: column and row of the region, 0 to 2
+layout (location = 1) in vec4 rect;
+layout (location = 2) in int depth;
+layout (location = 3) in float radians;
+layout (location = 4) in vec4 tint_;
+layout (location = 5) in vec4 borders; //Sprite9's widths then heights, in pixels of the sprite
+
+#include "${resources_dir}/shaders/common/uniforms.h"
+
+uniform sampler2D sprite;
+
+out vec2 texCoord;
+out vec4 tint;
+
+void main()
+{
+    //if the panel is smaller than its borders, the borders shrink to fit
+    vec2 widths = borders.xy*min(1.0,rect.z/max(borders.x + borders.y,0.0001));
+    vec2 heights = borders.zw*min(1.0,rect.w/max(borders.z + borders.w,0.0001));
+    vec2 spriteDimen = vec2(textureSize(sprite,0));
+
+    //where each region starts and ends, on the panel and in the sprite
+    vec4 xs = vec4(0,widths.x,rect.z - widths.y,rect.z);
+    vec4 ys = vec4(0,heights.x,rect.w - heights.y,rect.w);
+    vec4 us = vec4(0,borders.x/spriteDimen.x,1 - borders.y/spriteDimen.x,1);
+    vec4 vs = vec4(0,borders.z/spriteDimen.y,1 - borders.w/spriteDimen.y,1);
+
+    ivec2 region = ivec2(slice.zw);
+    vec2 position = vec2(mix(xs[region.x],xs[region.x + 1],slice.x),mix(ys[region.y],ys[region.y + 1],slice.y));
+    texCoord = vec2(mix(us[region.x],us[region.x + 1],slice.x),mix(vs[region.y],vs[region.y + 1],slice.y));
+
+    //rotate around the center of the panel, like getTransformed
+    vec2 offset = position - rect.zw*.5;
+    vec2 transformed = vec2(cos(radians)*offset.x - sin(radians)*offset.y,sin(radians)*offset.x + cos(radians)*offset.y);
+    transformed += rect.xy + rect.zw*.5;
+    gl_Position = projection*view*vec4(transformed,depth,1);
+
+    tint = tint_;
+}
@@ -0,0 +1,32 @@
+#version 330 core
+//animationShader, but the frame is worked out here from the time in the UBO instead of every frame on the CPU. Same math as BaseAnimation::getFrameFromStart
+
+layout (location = 0) in vec2 values;
+layout (location = 1) in vec4 rect;
+layout (location = 2) in int depth;
+layout (location = 3) in vec4 subsection; //the whole animation, BaseAnimation::subSection
+layout (location = 4) in float radians;
+layout (location = 5) in int perRow;
+layout (location = 6) in int rows;
+layout (location = 7) in int fps;
+layout (location = 8) in int start; //millisecond the animation started at, from SDL_GetTicks
+
+#include "${resources_dir}/shaders/common/vertex_common.h"
+
+#include "${resources_dir}/shaders/common/uniforms.h"
+
+out vec2 texCoord;
+
+void main()
+{
+    uint elapsed = time - uint(start);
+    uint speed = uint(max(fps,0));
+    //elapsed*fps/1000 without overflowing
+    uint frame = (elapsed/1000u)*speed + (elapsed%1000u)*speed/1000u;
+    uint across = uint(max(perRow,1));
+    uint down = uint(max(rows,1));
+    vec2 size = subsection.zw/vec2(across,down);
+    vec4 current = vec4(subsection.xy + size*vec2(frame%across,(frame/across)%down),size);
+
+    texCoord = getTransformed(0,values,rect,depth,radians,current,projection,view);
+}
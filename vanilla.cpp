@@ -4,6 +4,16 @@
 #include <math.h>
 #include <fstream>
 
+#ifdef _WIN32
+#define NOMINMAX //windows.h defines min and max macros otherwise
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "vanilla.h"
 
 int convertTo1(double number) // a method that converts a number to 1 or -1 depending on its sign. If entry is 0, return 0;
@@ -30,6 +40,113 @@ std::pair<std::string,bool> readFile(std::string file)
     return {"",false};
 }
 
+MappedFile::MappedFile(MappedFile&& other)
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+    if (this != &other)
+    {
+        close();
+        data = other.data;
+        size = other.size;
+        other.data = nullptr;
+        other.size = 0;
+#ifdef _WIN32
+        mapping = other.mapping;
+        other.mapping = nullptr;
+#endif
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& file)
+{
+    close();
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(file.c_str(),GENERIC_READ,FILE_SHARE_READ,nullptr,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle,&fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    mapping = CreateFileMappingA(handle,nullptr,PAGE_READONLY,0,0,nullptr);
+    CloseHandle(handle); //the mapping keeps the file open
+    if (!mapping)
+    {
+        return false;
+    }
+    data = static_cast<const unsigned char*>(MapViewOfFile(mapping,FILE_MAP_READ,0,0,0));
+    if (!data)
+    {
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+    size = fileSize.QuadPart;
+#else
+    int handle = ::open(file.c_str(),O_RDONLY);
+    if (handle == -1)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(handle,&info) != 0 || info.st_size == 0)
+    {
+        ::close(handle);
+        return false;
+    }
+    void* mapped = mmap(nullptr,info.st_size,PROT_READ,MAP_PRIVATE,handle,0);
+    ::close(handle); //the mapping keeps the file open
+    if (mapped == MAP_FAILED)
+    {
+        return false;
+    }
+    data = static_cast<const unsigned char*>(mapped);
+    size = info.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (!data)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    mapping = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(data),size);
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+const unsigned char* MappedFile::getData() const
+{
+    return data;
+}
+
+size_t MappedFile::getSize() const
+{
+    return size;
+}
+
 bool floatEquals(float a, float b, int precision)
 {
     return (int)(pow(10,precision)*a) == (int)(pow(10,precision)*b);
@@ -12,6 +12,7 @@
 #include <stack>
 #include <unordered_map>
 #include <regex>
+#include <stdint.h>
 
 
 
@@ -33,6 +34,26 @@ double randomDecimal(int places); //generates a random decimal between 0 and 1,
 
 std::pair<std::string,bool> readFile(std::string file); //reads "file" and returns the contents. The bool represents whether or not the file was found and successfully opened
 
+class MappedFile //maps a file into memory read only, so reading it doesn't copy it. Unmapped when destroyed
+{
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+    ~MappedFile();
+    bool open(const std::string& file); //returns false if the file couldn't be opened or is empty
+    void close();
+    const unsigned char* getData() const; //null if nothing is mapped
+    size_t getSize() const;
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* mapping = nullptr; //HANDLE, but we don't want windows.h in a header
+#endif
+};
+
 int charCount(std::string s, char c); //returns how many times c shows up in s;
 
 std::string* divideString(std::string input); //divides a string into parts and puts them all into an array
@@ -412,34 +433,56 @@ void fillBytesVec(std::vector<char>& bytesVec, int totalBytes, Args... args) //f
     bytesVec.resize(bytesVec.size() + totalBytes - sizeof(tup),'\0');
 }
 
-template<typename Lambda>
-void regexSearch(std::string reg, std::string str, Lambda lambda)
+/**
+  *   \brief Stable LSD radix sort of "items" by a 64 bit key, 8 bits at a time. Digits that are the same for every item are skipped, so keys that only
+  *   use a handful of bits only take a handful of passes. Items with equal keys stay in the order they were in.
+  *
+  *   \param items: what we are sorting
+  *   \param scratch: memory to sort into. Passing the same vector every time means we don't reallocate every time we sort
+  *   \param key: A "Callable", (const T&) -> uint64_t
+  *
+  *   \return nothing
+  **/
+template<typename T, typename Key>
+void radixSort(std::vector<T>& items, std::vector<T>& scratch, Key key)
 {
-    //given a string and a regex, parses the string using the regex, and runs "lambda" on each match
-    //lambda: (const std::smatch& -> void)
-    std::regex rgx(reg);
-    /*for (std::sregex_iterator it = std::sregex_iterator(str.begin(), str.end(), rgx);
-    it != std::sregex_iterator(); it++)
+    size_t size = items.size();
+    if (size < 2)
     {
-        lambda(it);
-    }*/
-    std::smatch match;
-    while (std::regex_search (str,match,rgx)) {
-        lambda(match);
-        str = match.suffix().str();
-   }
-}
+        return;
+    }
+    scratch.resize(size);
 
-template<typename Lambda>
-std::string regexReplace(const std::regex rgx, std::string str, Lambda lambda)
-{
-    //std::cout << str << "\n";
-    std::smatch match;
-    if (std::regex_search(str,match,rgx))
+    size_t counts[8][256] = {}; //histogram for every digit, all computed in one pass
+    for (size_t i = 0; i < size; ++i)
     {
-        return match.prefix().str() + lambda(str,match) + regexReplace(rgx,match.suffix().str(),lambda);
+        uint64_t k = key(items[i]);
+        for (int digit = 0; digit < 8; ++digit)
+        {
+            counts[digit][(k >> (digit*8)) & 255]++;
+        }
+    }
+
+    for (int digit = 0; digit < 8; ++digit)
+    {
+        size_t* count = counts[digit];
+        if (count[(key(items[0]) >> (digit*8)) & 255] == size) //every item has the same digit, this pass wouldn't change anything
+        {
+            continue;
+        }
+        size_t offsets[256];
+        size_t total = 0;
+        for (int i = 0; i < 256; ++i)
+        {
+            offsets[i] = total;
+            total += count[i];
+        }
+        for (size_t i = 0; i < size; ++i)
+        {
+            scratch[offsets[(key(items[i]) >> (digit*8)) & 255]++] = items[i];
+        }
+        items.swap(scratch);
     }
-    return str;
 }
 
 /**